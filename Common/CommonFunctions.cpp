@@ -75,6 +75,109 @@ Eigen::MatrixXd nullspaceExtraction(const Eigen::SparseMatrix<double> A)
 	return N;
 }
 
+Eigen::SparseMatrix<double> sparseNullspace(const Eigen::SparseMatrix<double>& A, double tol)
+{
+	const int n = A.cols();
+	std::vector<std::map<int, double> > rows(A.rows());
+	for (int k = 0; k < A.outerSize(); k++)
+		for (Eigen::SparseMatrix<double>::InnerIterator it(A, k); it; ++it)
+			rows[it.row()][it.col()] += it.value();
+
+	// slaves[d]: u_d = sum_j slaves[d][j] u_j, in terms of the DOFs that were masters when d was chosen
+	std::vector<std::map<int, double> > slaves(n);
+	std::vector<bool> isSlave(n, false);
+	std::vector<int> slaveOrder;
+	int numRedundant = 0;
+	for (auto& row : rows)
+	{
+		double rowScale = 0;
+		for (auto& it : row)
+			rowScale = std::max(rowScale, std::abs(it.second));
+
+		// eliminate the slaves chosen so far, their expressions may hold later slaves
+		bool hasSlave = true;
+		while (hasSlave)
+		{
+			hasSlave = false;
+			for (auto it = row.begin(); it != row.end(); )
+			{
+				if (!isSlave[it->first])
+				{
+					++it;
+					continue;
+				}
+				double c = it->second;
+				int d = it->first;
+				it = row.erase(it);
+				for (auto& s : slaves[d])
+					row[s.first] += c * s.second;
+				hasSlave = true;
+				break;
+			}
+		}
+
+		// the largest coefficient becomes the slave, which keeps the expressions well scaled
+		int slave = -1;
+		double maxCoeff = tol * rowScale;
+		for (auto& it : row)
+		{
+			if (std::abs(it.second) > maxCoeff)
+			{
+				maxCoeff = std::abs(it.second);
+				slave = it.first;
+			}
+		}
+		if (slave == -1)
+		{
+			numRedundant++;
+			continue;
+		}
+		double c = row[slave];
+		for (auto& it : row)
+			if (it.first != slave && std::abs(it.second) > tol * rowScale)
+				slaves[slave][it.first] = -it.second / c;
+		isSlave[slave] = true;
+		slaveOrder.push_back(slave);
+	}
+
+	// back substitution: a slave only refers to slaves chosen after it, which are resolved first
+	for (int k = slaveOrder.size() - 1; k >= 0; k--)
+	{
+		std::map<int, double> resolved;
+		for (auto& it : slaves[slaveOrder[k]])
+		{
+			if (isSlave[it.first])
+			{
+				for (auto& s : slaves[it.first])
+					resolved[s.first] += it.second * s.second;
+			}
+			else
+				resolved[it.first] += it.second;
+		}
+		slaves[slaveOrder[k]] = resolved;
+	}
+
+	std::vector<int> masterId(n, -1);
+	int numMasters = 0;
+	for (int i = 0; i < n; i++)
+		if (!isSlave[i])
+			masterId[i] = numMasters++;
+
+	std::vector<Eigen::Triplet<double> > T;
+	for (int i = 0; i < n; i++)
+	{
+		if (!isSlave[i])
+			T.push_back({ i, masterId[i], 1.0 });
+		else
+			for (auto& it : slaves[i])
+				T.push_back({ i, masterId[it.first], it.second });
+	}
+	Eigen::SparseMatrix<double> N(n, numMasters);
+	N.setFromTriplets(T.begin(), T.end());
+	std::cout << "linear constraints: " << A.rows() << " rows, " << numRedundant << " redundant, " << slaveOrder.size() << " slave DOFs, " << numMasters << " master DOFs" << std::endl;
+	return N;
+}
+
 double cotan(const Eigen::Vector3d v0, const Eigen::Vector3d v1, const Eigen::Vector3d v2)
 {
     double e0 = (v2 - v1).norm();
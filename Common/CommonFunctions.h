@@ -2,6 +2,7 @@
 #define COMMONFUNCTIONS_H
 
 #include <set>
+#include <map>
 
 #include <iostream>
 #include <fstream>
@@ -52,7 +53,8 @@ enum SolverType
 {
 	Lbfgs = 0,
 	Newton = 1,
-	ActiveSet = 2
+	ActiveSet = 2,
+	TrustRegion = 3
 };
 
 enum SFFType
@@ -102,6 +104,9 @@ void locatePotentialPureTensionFaces(const std::vector<Eigen::Matrix2d>& abars,
 void getPureTensionVertsEdges(const std::set<int>& potentialPureTensionFaces, const Eigen::MatrixXi& F, std::set<int>* pureTensionEdges, std::set<int> *pureTensionVerts);
 
 Eigen::MatrixXd nullspaceExtraction(const Eigen::SparseMatrix<double> A);
+// sparse basis T of the null space of A by master/slave elimination: every row of A turns one DOF into a slave, a combination
+// of the remaining (master) DOFs, and A (x0 + T q) = A x0 for all q. Rows depending on the previous ones (below tol) are skipped
+Eigen::SparseMatrix<double> sparseNullspace(const Eigen::SparseMatrix<double>& A, double tol = 1e-10);
 
 void trivialOffset(const Eigen::MatrixXd& V, const Eigen::MatrixXi& F, Eigen::MatrixXd &offsettedV, double d); // offfset V along its normal direction by a given distance
 
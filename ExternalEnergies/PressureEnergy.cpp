@@ -1,5 +1,7 @@
 
 #include <iostream>
+#include <algorithm>
+#include <tbb/tbb.h>
 #include "../MeshLib/GeometryDerivatives.h"
 #include "PressureEnergy.h"
 #include "../Common/CommonFunctions.h"
@@ -8,22 +10,11 @@ double pressureEnergyPerface(const Eigen::MatrixXi& F,
 	const Eigen::MatrixXd& curV,
 	double pressure,
 	int face,
-	Eigen::VectorXd* derivative,
-	Eigen::MatrixXd* hessian,
+	Eigen::Matrix<double, 9, 1>* derivative,
+	Eigen::Matrix<double, 9, 9>* hessian,
 	Eigen::VectorXd center, 
 	bool isProjHess)
 {
-	if (derivative)
-	{
-		derivative->resize(9);
-		derivative->setZero();
-	}
-	if (hessian)
-	{
-		hessian->resize(9, 9);
-		hessian->setZero();
-	}
-
 	double coef = -pressure / 6.0;
 	double result = 0;
 
@@ -31,37 +22,30 @@ double pressureEnergyPerface(const Eigen::MatrixXi& F,
     Eigen::Vector3d v1 = curV.row(F(face, 1)).transpose() - center;
     Eigen::Vector3d v2 = curV.row(F(face, 2)).transpose() - center;
 
-	double volume = v0.cross(v1).dot(v2);
 	result = coef * (v0.cross(v1).dot(v2));
 
-	Eigen::Vector3d n[3];
-	n[0] = v1.cross(v2); 
-	n[1] = v2.cross(v0); 
-	n[2] = v0.cross(v1); 
-
 	if (derivative)
 	{
-		for (int j = 0; j < 3; j++)
-		{
-			derivative->segment<3>(3 * j) = coef * n[j];
-		}
+		derivative->segment<3>(0) = coef * v1.cross(v2);
+		derivative->segment<3>(3) = coef * v2.cross(v0);
+		derivative->segment<3>(6) = coef * v0.cross(v1);
 	}
-	
-
-	std::vector<Eigen::Matrix3d> H(3);
-
-	H[0] = coef * crossMatrix(v0);
-	H[1] = coef * crossMatrix(v1);
-	H[2] = coef * crossMatrix(v2);
 
 	if (hessian)
 	{
-		hessian->block<3, 3>(0, 3) = -H[2];
-		hessian->block<3, 3>(0, 6) = H[1];
-		hessian->block<3, 3>(3, 0) = H[2];
-		hessian->block<3, 3>(3, 6) = -H[0];
-		hessian->block<3, 3>(6, 0) = -H[1];
-		hessian->block<3, 3>(6, 3) = H[0];
+		Eigen::Matrix3d H0 = coef * crossMatrix(v0);
+		Eigen::Matrix3d H1 = coef * crossMatrix(v1);
+		Eigen::Matrix3d H2 = coef * crossMatrix(v2);
+
+		hessian->block<3, 3>(0, 0).setZero();
+		hessian->block<3, 3>(0, 3) = -H2;
+		hessian->block<3, 3>(0, 6) = H1;
+		hessian->block<3, 3>(3, 0) = H2;
+		hessian->block<3, 3>(3, 3).setZero();
+		hessian->block<3, 3>(3, 6) = -H0;
+		hessian->block<3, 3>(6, 0) = -H1;
+		hessian->block<3, 3>(6, 3) = H0;
+		hessian->block<3, 3>(6, 6).setZero();
 
 		if (isProjHess)
 			*hessian = lowRankApprox(*hessian);
@@ -92,59 +76,202 @@ double pressureEnergy(
 	if (hessian)
 	{
 		hessian->clear();
+		hessian->resize(81 * nfaces);
 	}
 
 	double result = 0;
 
 	auto energies = std::vector<double>(nfaces);
-	auto derivs = std::vector<Eigen::VectorXd>(nfaces);
-	auto hesses = std::vector<Eigen::MatrixXd>(nfaces);
+	auto derivs = std::vector<Eigen::Matrix<double, 9, 1> >(dEnergy ? nfaces : 0);
 
-	if (isParallel)
+	// every face owns its own 81 slots in the triplet list, so the triplets are written in parallel as well
+	auto computePressure = [&](const tbb::blocked_range<uint32_t>& range)
 	{
-		auto computePressure = [&](const tbb::blocked_range<uint32_t>& range)
+		for (uint32_t i = range.begin(); i < range.end(); ++i)
 		{
-			for (uint32_t i = range.begin(); i < range.end(); ++i)
+			Eigen::Matrix<double, 9, 9> localHess;
+			energies[i] = pressureEnergyPerface(F, curV, pressure, i, dEnergy ? &derivs[i] : NULL, hessian ? &localHess : NULL, center, isProjHess);
+
+			if (hessian)
 			{
-				energies[i] = pressureEnergyPerface(F, curV, pressure, i, dEnergy || hessian ? &derivs[i] : NULL, dEnergy || hessian ? &hesses[i] : NULL, center, isProjHess);
+				for (int j = 0; j < 3; j++)
+					for (int k = 0; k < 3; k++)
+						for (int l = 0; l < 3; l++)
+							for (int m = 0; m < 3; m++)
+								(*hessian)[81 * i + 27 * j + 9 * k + 3 * l + m] = Eigen::Triplet<double>(3 * F(i, j) + l, 3 * F(i, k) + m, localHess(3 * j + l, 3 * k + m));
 			}
-		};
+		}
+	};
 
-		tbb::blocked_range<uint32_t> rangex(0u, (uint32_t)nfaces);
+	tbb::blocked_range<uint32_t> rangex(0u, (uint32_t)nfaces);
+	if (isParallel)
 		tbb::parallel_for(rangex, computePressure);
-	}
 	else
+		computePressure(rangex);
+
+	for (int i = 0; i < nfaces; i++)
 	{
-		for (int i = 0; i < nfaces; i++)
+		result += energies[i];
+		if (dEnergy)
 		{
-			energies[i] = pressureEnergyPerface(F, curV, pressure, i, dEnergy || hessian ? &derivs[i] : NULL, dEnergy || hessian ? &hesses[i] : NULL, center, isProjHess);
+			for (int j = 0; j < 3; j++)
+				dEnergy->segment<3>(3 * F(i, j)) += derivs[i].segment<3>(3 * j);
 		}
 	}
+	return result;
+}
+
+void PressureEnergyCache::initialize(const Eigen::MatrixXi& F, int nverts)
+{
+	_F = F;
+	_nverts = nverts;
+	int nfaces = F.rows();
 
+	// sparsity pattern of the pressure hessian, with one slot per (face, local entry) pointing into it
+	std::vector<Eigen::Triplet<double> > T(81 * nfaces);
 	for (int i = 0; i < nfaces; i++)
+		for (int j = 0; j < 3; j++)
+			for (int k = 0; k < 3; k++)
+				for (int l = 0; l < 3; l++)
+					for (int m = 0; m < 3; m++)
+						T[81 * i + 27 * j + 9 * k + 3 * l + m] = Eigen::Triplet<double>(3 * F(i, j) + l, 3 * F(i, k) + m, 1.0);
+	_pattern.resize(3 * nverts, 3 * nverts);
+	_pattern.setFromTriplets(T.begin(), T.end());
+	_pattern.makeCompressed();
+
+	// invert the (face, local entry) -> nonzero map, so that each nonzero gathers its own contributions without races
+	int nnz = _pattern.nonZeros();
+	std::vector<int> slotToNonzero(81 * nfaces);
+	for (int s = 0; s < T.size(); s++)
 	{
-		result += energies[i];
+		int row = T[s].row();
+		int col = T[s].col();
+		const int* begin = _pattern.innerIndexPtr() + _pattern.outerIndexPtr()[col];
+		const int* end = _pattern.innerIndexPtr() + _pattern.outerIndexPtr()[col + 1];
+		slotToNonzero[s] = std::lower_bound(begin, end, row) - _pattern.innerIndexPtr();
+	}
+
+	_gatherStart.assign(nnz + 1, 0);
+	for (int s = 0; s < slotToNonzero.size(); s++)
+		_gatherStart[slotToNonzero[s] + 1]++;
+	for (int k = 0; k < nnz; k++)
+		_gatherStart[k + 1] += _gatherStart[k];
+	_gatherSlots.resize(slotToNonzero.size());
+	std::vector<int> fill(_gatherStart.begin(), _gatherStart.end() - 1);
+	for (int s = 0; s < slotToNonzero.size(); s++)
+		_gatherSlots[fill[slotToNonzero[s]]++] = s;
+
+	// the same inversion for the gradient: every vertex lists the face corners it sits on
+	_vertCornerStart.assign(nverts + 1, 0);
+	for (int i = 0; i < nfaces; i++)
+		for (int j = 0; j < 3; j++)
+			_vertCornerStart[F(i, j) + 1]++;
+	for (int v = 0; v < nverts; v++)
+		_vertCornerStart[v + 1] += _vertCornerStart[v];
+	_vertCorners.resize(3 * nfaces);
+	std::vector<int> vfill(_vertCornerStart.begin(), _vertCornerStart.end() - 1);
+	for (int i = 0; i < nfaces; i++)
 		for (int j = 0; j < 3; j++)
+			_vertCorners[vfill[F(i, j)]++] = 3 * i + j;
+}
+
+double PressureEnergyCache::energy(const Eigen::MatrixXd& curPos, double pressure, bool isParallel)
+{
+	int nfaces = _F.rows();
+	std::vector<double> faceVolumes(nfaces);
+	auto computeVolume = [&](const tbb::blocked_range<uint32_t>& range)
+	{
+		for (uint32_t i = range.begin(); i < range.end(); ++i)
+			faceVolumes[i] = faceVolume(curPos, i);
+	};
+	tbb::blocked_range<uint32_t> rangex(0u, (uint32_t)nfaces);
+	if (isParallel)
+		tbb::parallel_for(rangex, computeVolume);
+	else
+		computeVolume(rangex);
+
+	double volume = 0;
+	for (int i = 0; i < nfaces; i++)
+		volume += faceVolumes[i];
+
+	return -pressure * volume;
+}
+
+void PressureEnergyCache::gradient(const Eigen::MatrixXd& curPos, double pressure, Eigen::VectorXd& grad, bool isParallel)
+{
+	double coef = -pressure / 6.0;
+	grad.resize(3 * _nverts);
+
+	// d(v0 x v1 . v2) / dv_j = v_{j+1} x v_{j+2}, summed over the corners of each vertex
+	auto gather = [&](const tbb::blocked_range<uint32_t>& range)
+	{
+		for (uint32_t v = range.begin(); v < range.end(); ++v)
 		{
-			if (dEnergy)
-				dEnergy->segment<3>(3 * F(i, j)) += derivs[i].segment<3>(3 * j);
-			if (hessian)
+			Eigen::Vector3d sum = Eigen::Vector3d::Zero();
+			for (int s = _vertCornerStart[v]; s < _vertCornerStart[v + 1]; s++)
 			{
-				Eigen::MatrixXd localHess = hesses[i];
+				int face = _vertCorners[s] / 3;
+				int j = _vertCorners[s] % 3;
+				Eigen::Vector3d v1 = curPos.row(_F(face, (j + 1) % 3)).transpose();
+				Eigen::Vector3d v2 = curPos.row(_F(face, (j + 2) % 3)).transpose();
+				sum += v1.cross(v2);
+			}
+			grad.segment<3>(3 * v) = coef * sum;
+		}
+	};
+	tbb::blocked_range<uint32_t> vertRange(0u, (uint32_t)_nverts);
+	if (isParallel)
+		tbb::parallel_for(vertRange, gather);
+	else
+		gather(vertRange);
+}
 
-				for (int k = 0; k < 3; k++)
-				{
-					for (int l = 0; l < 3; l++)
-					{
-						hessian->push_back(Eigen::Triplet<double>(3 * F(i, j) + k, 3 * F(i, 0) + l, localHess(3 * j + k, 3 * 0 + l)));
-						hessian->push_back(Eigen::Triplet<double>(3 * F(i, j) + k, 3 * F(i, 1) + l, localHess(3 * j + k, 3 * 1 + l)));
-						hessian->push_back(Eigen::Triplet<double>(3 * F(i, j) + k, 3 * F(i, 2) + l, localHess(3 * j + k, 3 * 2 + l)));
-					}
-				}
+void PressureEnergyCache::hessian(const Eigen::MatrixXd& curPos, double pressure, Eigen::SparseMatrix<double>& H, bool isParallel)
+{
+	int nfaces = _F.rows();
+	std::vector<Eigen::Matrix<double, 9, 9> > hesses(nfaces);
+
+	auto computeHessian = [&](const tbb::blocked_range<uint32_t>& range)
+	{
+		for (uint32_t i = range.begin(); i < range.end(); ++i)
+			pressureEnergyPerface(_F, curPos, pressure, i, NULL, &hesses[i], Eigen::Vector3d::Zero(), false);
+	};
+	tbb::blocked_range<uint32_t> faceRange(0u, (uint32_t)nfaces);
+	if (isParallel)
+		tbb::parallel_for(faceRange, computeHessian);
+	else
+		computeHessian(faceRange);
+
+	H = _pattern;
+	double* values = H.valuePtr();
+	auto gather = [&](const tbb::blocked_range<uint32_t>& range)
+	{
+		for (uint32_t k = range.begin(); k < range.end(); ++k)
+		{
+			double sum = 0;
+			for (int s = _gatherStart[k]; s < _gatherStart[k + 1]; s++)
+			{
+				int slot = _gatherSlots[s];
+				int local = slot % 81;
+				// slot layout: 27 * j + 9 * k + 3 * l + m  <->  localHess(3 * j + l, 3 * k + m)
+				sum += hesses[slot / 81](3 * (local / 27) + (local % 9) / 3, 3 * ((local / 9) % 3) + local % 3);
 			}
+			values[k] = sum;
 		}
-	}
-	return result;
+	};
+	tbb::blocked_range<uint32_t> nnzRange(0u, (uint32_t)H.nonZeros());
+	if (isParallel)
+		tbb::parallel_for(nnzRange, gather);
+	else
+		gather(nnzRange);
+}
+
+double PressureEnergyCache::faceVolume(const Eigen::MatrixXd& curPos, int face) const
+{
+	Eigen::Vector3d v0 = curPos.row(_F(face, 0)).transpose();
+	Eigen::Vector3d v1 = curPos.row(_F(face, 1)).transpose();
+	Eigen::Vector3d v2 = curPos.row(_F(face, 2)).transpose();
+	return v0.cross(v1).dot(v2) / 6.0;
 }
 
 
@@ -227,8 +354,8 @@ void testPressureEnergyPerface(
 {
 	std::cout << std::endl << "Testing pressure: " << std::endl;
 
-	Eigen::VectorXd dp;
-	Eigen::MatrixXd hp;
+	Eigen::Matrix<double, 9, 1> dp;
+	Eigen::Matrix<double, 9, 9> hp;
 
 	double f = pressureEnergyPerface(F, curPos, pressure,face, &dp, &hp, center);
 
@@ -239,7 +366,7 @@ void testPressureEnergyPerface(
 	{
 		double eps = std::pow(10, -i);
 		Eigen::MatrixXd disturbPos = curPos;
-		Eigen::VectorXd dp1;
+		Eigen::Matrix<double, 9, 1> dp1;
 		for (int j = 0; j < 3; j++)
 		{
 			int vid = F(face, j);
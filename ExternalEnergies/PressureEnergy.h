@@ -21,11 +21,41 @@ double pressureEnergyPerface(const Eigen::MatrixXi& F,
     const Eigen::MatrixXd& curPos,
     double pressure,
     int face,
-    Eigen::VectorXd* derivative,
-    Eigen::MatrixXd* hessian,
+    Eigen::Matrix<double, 9, 1>* derivative,
+    Eigen::Matrix<double, 9, 9>* hessian,
     Eigen::VectorXd center = Eigen::Vector3d::Zero(),
     bool isProjHess = false);
 
+/*
+ * Cached pressure energy (center at the origin). The hessian sparsity pattern and the vertex -> face corners map are
+ * built once, and each hessian nonzero / gradient entry gathers its per-face contributions in parallel, without
+ * triplets, setFromTriplets or a serial scatter.
+ */
+class PressureEnergyCache
+{
+public:
+    void initialize(const Eigen::MatrixXi& F, int nverts);
+
+    double energy(const Eigen::MatrixXd& curPos, double pressure, bool isParallel = false);
+    // 3|V| gradient
+    void gradient(const Eigen::MatrixXd& curPos, double pressure, Eigen::VectorXd& grad, bool isParallel = false);
+    // 3|V| x 3|V| hessian, written into the cached pattern
+    void hessian(const Eigen::MatrixXd& curPos, double pressure, Eigen::SparseMatrix<double>& H, bool isParallel = false);
+
+    bool isInitialized() const { return _F.rows() > 0; }
+
+private:
+    double faceVolume(const Eigen::MatrixXd& curPos, int face) const;
+
+    Eigen::MatrixXi _F;
+    int _nverts = 0;
+    Eigen::SparseMatrix<double> _pattern;
+    std::vector<int> _gatherStart;     // CSR-like offsets into _gatherSlots, one row per nonzero
+    std::vector<int> _gatherSlots;     // face * 81 + local entry
+    std::vector<int> _vertCornerStart; // CSR-like offsets into _vertCorners, one row per vertex
+    std::vector<int> _vertCorners;     // face * 3 + corner
+};
+
 void testPressureEnergy(
     const Eigen::MatrixXi& F,
     const Eigen::MatrixXd& curPos,
@@ -0,0 +1,307 @@
+#include <iostream>
+#include <algorithm>
+#include "AMGPreconditioner.h"
+
+static Eigen::VectorXd inverseDiagonal(const Eigen::SparseMatrix<double>& A)
+{
+	Eigen::VectorXd invDiag = A.diagonal();
+	for (int i = 0; i < invDiag.size(); i++)
+		invDiag[i] = invDiag[i] != 0 ? 1.0 / std::abs(invDiag[i]) : 1.0;
+	return invDiag;
+}
+
+// spectral radius of D^{-1} A by power iterations
+static double spectralRadiusEstimate(const Eigen::SparseMatrix<double>& A, const Eigen::VectorXd& invDiag, int numIters = 15)
+{
+	Eigen::VectorXd v = Eigen::VectorXd::Ones(A.rows()) + 0.1 * Eigen::VectorXd::Random(A.rows());
+	double rho = 1.0;
+	for (int i = 0; i < numIters; i++)
+	{
+		v.normalize();
+		Eigen::VectorXd w = invDiag.cwiseProduct(A * v);
+		rho = w.norm();
+		if (rho == 0)
+			return 1.0;
+		v = w;
+	}
+	return rho;
+}
+
+AMGPreconditioner::AMGPreconditioner(const std::vector<int>& dofNodes, const Eigen::MatrixXd& nearNullspace, int maxLevels, int coarsestSize, double strengthTheta, int smoothingSteps)
+	: _dofNodes(dofNodes), _nearNullspace(nearNullspace), _maxLevels(maxLevels), _coarsestSize(coarsestSize), _theta(strengthTheta), _smoothingSteps(smoothingSteps)
+{
+}
+
+int AMGPreconditioner::aggregate(const Eigen::SparseMatrix<double>& A, const std::vector<int>& dofNodes, std::vector<int>& nodeAggregates) const
+{
+	int nNodes = *std::max_element(dofNodes.begin(), dofNodes.end()) + 1;
+
+	// node strength graph: squared Frobenius norms of the nodal blocks
+	std::vector<Eigen::Triplet<double> > T;
+	T.reserve(A.nonZeros());
+	for (int k = 0; k < A.outerSize(); k++)
+		for (Eigen::SparseMatrix<double>::InnerIterator it(A, k); it; ++it)
+			T.push_back({ dofNodes[it.row()], dofNodes[it.col()], it.value() * it.value() });
+	Eigen::SparseMatrix<double> S(nNodes, nNodes);
+	S.setFromTriplets(T.begin(), T.end());
+	Eigen::VectorXd nodeDiag = S.diagonal();
+
+	std::vector<std::vector<int> > strongNeighbors(nNodes);
+	for (int k = 0; k < S.outerSize(); k++)
+		for (Eigen::SparseMatrix<double>::InnerIterator it(S, k); it; ++it)
+		{
+			int i = it.row(), j = it.col();
+			if (i != j && it.value() > _theta * _theta * std::sqrt(nodeDiag[i] * nodeDiag[j]))
+				strongNeighbors[i].push_back(j);
+		}
+
+	nodeAggregates.assign(nNodes, -1);
+	int nAggregates = 0;
+
+	// pass 1: nodes whose strong neighborhood is still free seed a new aggregate
+	for (int i = 0; i < nNodes; i++)
+	{
+		if (nodeAggregates[i] != -1 || nodeDiag[i] == 0)
+			continue;
+		bool isFree = true;
+		for (int j : strongNeighbors[i])
+			if (nodeAggregates[j] != -1)
+			{
+				isFree = false;
+				break;
+			}
+		if (!isFree)
+			continue;
+		nodeAggregates[i] = nAggregates;
+		for (int j : strongNeighbors[i])
+			nodeAggregates[j] = nAggregates;
+		nAggregates++;
+	}
+
+	// pass 2: attach the remaining nodes to a strongly connected aggregate
+	std::vector<int> pass1Aggregates = nodeAggregates;
+	for (int i = 0; i < nNodes; i++)
+	{
+		if (nodeAggregates[i] != -1)
+			continue;
+		for (int j : strongNeighbors[i])
+			if (pass1Aggregates[j] != -1)
+			{
+				nodeAggregates[i] = pass1Aggregates[j];
+				break;
+			}
+	}
+
+	// pass 3: whatever is left (including nodes without DOFs on this level) forms its own aggregates
+	for (int i = 0; i < nNodes; i++)
+	{
+		if (nodeAggregates[i] != -1 || nodeDiag[i] == 0)
+			continue;
+		nodeAggregates[i] = nAggregates;
+		for (int j : strongNeighbors[i])
+			if (nodeAggregates[j] == -1)
+				nodeAggregates[j] = nAggregates;
+		nAggregates++;
+	}
+	return nAggregates;
+}
+
+Eigen::SparseMatrix<double> AMGPreconditioner::tentativeProlongator(const std::vector<int>& dofNodes, const std::vector<int>& nodeAggregates, int nAggregates, const Eigen::MatrixXd& B, Eigen::MatrixXd& coarseB, std::vector<int>& coarseDofNodes) const
+{
+	int ndofs = dofNodes.size();
+	std::vector<std::vector<int> > aggDofs(nAggregates);
+	for (int i = 0; i < ndofs; i++)
+	{
+		int agg = nodeAggregates[dofNodes[i]];
+		if (agg == -1)
+		{
+			// isolated DOF (zero row), give it its own aggregate
+			agg = aggDofs.size();
+			aggDofs.push_back({});
+		}
+		aggDofs[agg].push_back(i);
+	}
+
+	std::vector<Eigen::Triplet<double> > T;
+	std::vector<Eigen::MatrixXd> coarseBBlocks;
+	coarseDofNodes.clear();
+	int ncoarse = 0;
+	for (int a = 0; a < aggDofs.size(); a++)
+	{
+		int m = aggDofs[a].size();
+		if (m == 0)
+			continue;
+		Eigen::MatrixXd Bagg(m, B.cols());
+		for (int i = 0; i < m; i++)
+			Bagg.row(i) = B.row(aggDofs[a][i]);
+
+		// B_agg P = Q R, keep the numerically independent columns
+		Eigen::ColPivHouseholderQR<Eigen::MatrixXd> qr(Bagg);
+		qr.setThreshold(1e-10);
+		int rank = qr.rank();
+		Eigen::MatrixXd Q, Rr;
+		if (rank == 0)
+		{
+			rank = 1;
+			Q = Eigen::MatrixXd::Constant(m, 1, 1.0 / std::sqrt(m));
+			Rr = Eigen::MatrixXd::Zero(1, B.cols());
+		}
+		else
+		{
+			Q = qr.householderQ() * Eigen::MatrixXd::Identity(m, rank);
+			Rr = qr.matrixR().topRows(rank).triangularView<Eigen::Upper>();
+			Rr = Rr * qr.colsPermutation().transpose();
+		}
+
+		for (int i = 0; i < m; i++)
+			for (int j = 0; j < rank; j++)
+				T.push_back({ aggDofs[a][i], ncoarse + j, Q(i, j) });
+		coarseBBlocks.push_back(Rr);
+		for (int j = 0; j < rank; j++)
+			coarseDofNodes.push_back(coarseBBlocks.size() - 1);
+		ncoarse += rank;
+	}
+
+	coarseB.resize(ncoarse, B.cols());
+	int row = 0;
+	for (auto& block : coarseBBlocks)
+	{
+		coarseB.middleRows(row, block.rows()) = block;
+		row += block.rows();
+	}
+
+	Eigen::SparseMatrix<double> P(ndofs, ncoarse);
+	P.setFromTriplets(T.begin(), T.end());
+	return P;
+}
+
+bool AMGPreconditioner::compute(const Eigen::SparseMatrix<double>& A)
+{
+	_levels.clear();
+
+	// compact the node ids, and fall back to plain 3x3 nodes / translations if the model did not provide them
+	std::vector<int> dofNodes = _dofNodes;
+	Eigen::MatrixXd B = _nearNullspace;
+	if (dofNodes.size() != A.rows())
+	{
+		dofNodes.resize(A.rows());
+		for (int i = 0; i < A.rows(); i++)
+			dofNodes[i] = i / 3;
+	}
+	if (B.rows() != A.rows())
+	{
+		B = Eigen::MatrixXd::Zero(A.rows(), 3);
+		for (int i = 0; i < A.rows(); i++)
+			B(i, i % 3) = 1;
+	}
+	std::vector<int> nodeIds(*std::max_element(dofNodes.begin(), dofNodes.end()) + 1, -1);
+	int nNodes = 0;
+	for (int& n : dofNodes)
+	{
+		if (nodeIds[n] == -1)
+			nodeIds[n] = nNodes++;
+		n = nodeIds[n];
+	}
+
+	Eigen::SparseMatrix<double> curA = A;
+	bool isPositive = true;
+	while (true)
+	{
+		AMGLevel level;
+		level.A = curA;
+		level.invDiag = inverseDiagonal(curA);
+		level.dofNodes = dofNodes;
+		if (_levels.empty())
+		{
+			Eigen::VectorXd diag = curA.diagonal();
+			isPositive = diag.size() == 0 || diag.minCoeff() > 0;
+		}
+
+		if (curA.rows() <= _coarsestSize || _levels.size() + 1 >= _maxLevels)
+		{
+			_levels.push_back(level);
+			break;
+		}
+
+		std::vector<int> nodeAggregates;
+		int nAggregates = aggregate(curA, dofNodes, nodeAggregates);
+		Eigen::MatrixXd coarseB;
+		std::vector<int> coarseDofNodes;
+		Eigen::SparseMatrix<double> Ptent = tentativeProlongator(dofNodes, nodeAggregates, nAggregates, B, coarseB, coarseDofNodes);
+		if (Ptent.cols() == 0 || Ptent.cols() > 0.9 * curA.rows())
+		{
+			// aggregation stalled
+			_levels.push_back(level);
+			break;
+		}
+
+		// prolongator smoothing: P = (I - 4/3 / rho D^{-1} A) Ptent
+		double rho = spectralRadiusEstimate(curA, level.invDiag);
+		level.omega = 4.0 / 3.0 / rho;
+		Eigen::SparseMatrix<double> DinvA = level.invDiag.asDiagonal() * curA;
+		level.P = Ptent - (4.0 / 3.0 / rho) * (DinvA * Ptent);
+		level.P.prune(1e-14, 1.0);
+		level.R = level.P.transpose();
+
+		curA = level.R * curA * level.P;
+		curA.makeCompressed();
+		B = coarseB;
+		dofNodes = coarseDofNodes;
+		_levels.push_back(level);
+	}
+
+	Eigen::SparseMatrix<double> coarsestA = _levels.back().A;
+	_coarseSolver.compute(coarsestA);
+	if (_coarseSolver.info() != Eigen::Success)
+	{
+		// singular coarse problem (e.g. free rigid-body modes), regularize a little
+		Eigen::SparseMatrix<double> I(coarsestA.rows(), coarsestA.cols());
+		I.setIdentity();
+		double shift = 1e-10 * std::max(1.0, coarsestA.diagonal().cwiseAbs().maxCoeff());
+		_coarseSolver.compute(coarsestA + shift * I);
+	}
+
+	std::cout << "AMG levels: " << _levels.size() << ", coarsest size: " << coarsestA.rows() << ", operator complexity: " << operatorComplexity() << std::endl;
+	return isPositive;
+}
+
+double AMGPreconditioner::operatorComplexity() const
+{
+	if (_levels.empty())
+		return 0;
+	double nnz = 0;
+	for (auto& level : _levels)
+		nnz += level.A.nonZeros();
+	return nnz / _levels[0].A.nonZeros();
+}
+
+void AMGPreconditioner::vcycle(int level, const Eigen::VectorXd& b, Eigen::VectorXd& x) const
+{
+	const AMGLevel& cur = _levels[level];
+	if (level == _levels.size() - 1)
+	{
+		x = _coarseSolver.solve(b);
+		return;
+	}
+
+	// the damping comes from the spectral radius of D^{-1} A, a fixed 2/3 diverges once it exceeds 3
+	const double omega = cur.omega;
+	x = Eigen::VectorXd::Zero(b.size());
+	for (int s = 0; s < _smoothingSteps; s++)
+		x += omega * cur.invDiag.cwiseProduct(b - cur.A * x);
+
+	Eigen::VectorXd bc = cur.R * (b - cur.A * x);
+	Eigen::VectorXd xc;
+	vcycle(level + 1, bc, xc);
+	x += cur.P * xc;
+
+	for (int s = 0; s < _smoothingSteps; s++)
+		x += omega * cur.invDiag.cwiseProduct(b - cur.A * x);
+}
+
+Eigen::VectorXd AMGPreconditioner::apply(const Eigen::VectorXd& r) const
+{
+	Eigen::VectorXd x;
+	vcycle(0, r, x);
+	return x;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <vector>
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+#include "LinearSolver.h"
+
+/*
+ * Smoothed aggregation algebraic multigrid (Vanek, Mandel and Brezina), used as a preconditioner of PCG.
+ * The DOFs are aggregated node-wise (the 3 coordinates of a vertex stay together), the tentative prolongators interpolate the
+ * near-nullspace (the rigid-body modes of the shell, see ElasticShellModel::nearNullspace) exactly, and are smoothed by one
+ * damped Jacobi step. Each V-cycle uses symmetric damped Jacobi smoothing and a direct solve on the coarsest level.
+ */
+class AMGPreconditioner : public Preconditioner
+{
+public:
+    AMGPreconditioner(const std::vector<int>& dofNodes, const Eigen::MatrixXd& nearNullspace, int maxLevels = 10, int coarsestSize = 1000, double strengthTheta = 0.08, int smoothingSteps = 2);
+
+    virtual std::string name() const override { return "amg"; }
+    virtual bool compute(const Eigen::SparseMatrix<double>& A) override;
+    virtual Eigen::VectorXd apply(const Eigen::VectorXd& r) const override;
+
+    int numLevels() const { return _levels.size(); }
+    double operatorComplexity() const;
+
+private:
+    struct AMGLevel
+    {
+        Eigen::SparseMatrix<double> A;
+        Eigen::SparseMatrix<double> P;     // prolongation to this level from the next coarser one
+        Eigen::SparseMatrix<double> R;     // restriction, P^T
+        Eigen::VectorXd invDiag;
+        double omega = 2.0 / 3.0;          // Jacobi damping, 4 / (3 rho(D^{-1} A))
+        std::vector<int> dofNodes;
+    };
+
+    // node-wise aggregation on the strength graph, returns the number of aggregates
+    int aggregate(const Eigen::SparseMatrix<double>& A, const std::vector<int>& dofNodes, std::vector<int>& nodeAggregates) const;
+    // tentative prolongator fitting the near-nullspace B per aggregate, also returns the coarse near-nullspace and DOF -> node map
+    Eigen::SparseMatrix<double> tentativeProlongator(const std::vector<int>& dofNodes, const std::vector<int>& nodeAggregates, int nAggregates, const Eigen::MatrixXd& B, Eigen::MatrixXd& coarseB, std::vector<int>& coarseDofNodes) const;
+    void vcycle(int level, const Eigen::VectorXd& b, Eigen::VectorXd& x) const;
+
+    std::vector<int> _dofNodes;
+    Eigen::MatrixXd _nearNullspace;
+    int _maxLevels;
+    int _coarsestSize;
+    double _theta;
+    int _smoothingSteps;
+
+    std::vector<AMGLevel> _levels;
+    Eigen::SimplicialLDLT<Eigen::SparseMatrix<double> > _coarseSolver;
+};
@@ -0,0 +1,100 @@
+#include <iostream>
+#include "GeometricMultigrid.h"
+
+GeometricMultigrid::GeometricMultigrid(const std::vector<Eigen::SparseMatrix<double> >& prolongators, const std::vector<Eigen::SparseMatrix<double> >& levelOperators, int smoothingSteps, bool isVerbose)
+	: _prolongators(prolongators), _levelOperators(levelOperators), _smoothingSteps(smoothingSteps), _isVerbose(isVerbose)
+{
+	_restrictions.resize(_prolongators.size());
+	for (int l = 0; l < _prolongators.size(); l++)
+		_restrictions[l] = _prolongators[l].transpose();
+}
+
+bool GeometricMultigrid::compute(const Eigen::SparseMatrix<double>& A)
+{
+	int nlevels = _prolongators.size() + 1;
+	if (_prolongators.empty() || _prolongators.back().rows() != A.rows())
+	{
+		// only this matrix bypasses the hierarchy, the prolongators stay for the next matching one
+		if (_isVerbose)
+			std::cout << "the multigrid hierarchy does not match the system size, use a single level." << std::endl;
+		nlevels = 1;
+	}
+
+	_operators.resize(nlevels);
+	_operators[nlevels - 1] = A;
+	// the level operators are only used if they match the hierarchy (coarsest first, without the finest level)
+	bool isAssembled = (_levelOperators.size() == nlevels - 1);
+	for (int l = 0; l < nlevels - 1 && isAssembled; l++)
+		isAssembled = (_levelOperators[l].rows() == _prolongators[l].cols());
+
+	for (int l = nlevels - 2; l >= 0; l--)
+	{
+		if (isAssembled)
+			_operators[l] = _levelOperators[l];
+		else
+			_operators[l] = _restrictions[l] * _operators[l + 1] * _prolongators[l];
+		_operators[l].makeCompressed();
+	}
+
+	_coarseSolver.compute(_operators[0]);
+	if (_coarseSolver.info() != Eigen::Success)
+	{
+		Eigen::SparseMatrix<double> I(_operators[0].rows(), _operators[0].cols());
+		I.setIdentity();
+		double shift = 1e-10 * std::max(1.0, _operators[0].diagonal().cwiseAbs().maxCoeff());
+		_coarseSolver.compute(_operators[0] + shift * I);
+	}
+	if (_isVerbose)
+		std::cout << "multigrid levels: " << nlevels << ", coarsest size: " << _operators[0].rows() << (isAssembled ? ", assembled" : ", Galerkin") << " coarse operators" << std::endl;
+
+	Eigen::VectorXd diag = A.diagonal();
+	return diag.size() == 0 || diag.minCoeff() > 0;
+}
+
+void GeometricMultigrid::vcycle(int level, const Eigen::VectorXd& b, Eigen::VectorXd& x) const
+{
+	if (level == 0)
+	{
+		x = _coarseSolver.solve(b);
+		return;
+	}
+	const Eigen::SparseMatrix<double>& A = _operators[level];
+
+	// forward Gauss-Seidel
+	x = Eigen::VectorXd::Zero(b.size());
+	for (int s = 0; s < _smoothingSteps; s++)
+		x += A.triangularView<Eigen::Lower>().solve(b - A * x);
+
+	Eigen::VectorXd bc = _restrictions[level - 1] * (b - A * x);
+	Eigen::VectorXd xc;
+	vcycle(level - 1, bc, xc);
+	x += _prolongators[level - 1] * xc;
+
+	// backward Gauss-Seidel, keeps the cycle symmetric
+	for (int s = 0; s < _smoothingSteps; s++)
+		x += A.triangularView<Eigen::Upper>().solve(b - A * x);
+}
+
+Eigen::VectorXd GeometricMultigrid::apply(const Eigen::VectorXd& r) const
+{
+	Eigen::VectorXd x;
+	vcycle(_operators.size() - 1, r, x);
+	return x;
+}
+
+Eigen::VectorXd PreconditionedIterationSolver::solve(const Eigen::VectorXd& rhs)
+{
+	Eigen::VectorXd x = Eigen::VectorXd::Zero(rhs.size());
+	double bnorm = rhs.norm();
+	Eigen::VectorXd r = rhs;
+	for (_lastIters = 0; _lastIters < _maxIter; _lastIters++)
+	{
+		if (r.norm() <= _tol * bnorm)
+			break;
+		x += _precon->apply(r);
+		r = rhs - _A * x;
+	}
+	// NaN when the iterations diverged, which is not converged either
+	_lastRelRes = bnorm > 0 ? r.norm() / bnorm : 0;
+	return x;
+}
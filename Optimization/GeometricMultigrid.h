@@ -0,0 +1,67 @@
+#pragma once
+#include <vector>
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+#include "LinearSolver.h"
+
+/*
+ * Geometric multigrid over the nested midpoint subdivision hierarchy of the rest mesh (see ElasticSetup::subdivisionLevels).
+ * The prolongators map the free DOFs of level l to level l + 1 (coarsest first), the restrictions are their transposes. The
+ * coarse operators are either assembled on each level (e.g. the constant bending hessian) or, if not given or mismatched,
+ * the Galerkin products P^T A P. Each V-cycle uses forward / backward Gauss-Seidel smoothing, so it is symmetric and can
+ * precondition CG. A matrix that does not match the finest level (e.g. a reduced system) is solved on a single level, the
+ * hierarchy is kept for the next matching one.
+ */
+class GeometricMultigrid : public Preconditioner
+{
+public:
+    GeometricMultigrid(const std::vector<Eigen::SparseMatrix<double> >& prolongators, const std::vector<Eigen::SparseMatrix<double> >& levelOperators = {}, int smoothingSteps = 2, bool isVerbose = false);
+
+    virtual std::string name() const override { return "gmg"; }
+    virtual bool compute(const Eigen::SparseMatrix<double>& A) override;
+    virtual Eigen::VectorXd apply(const Eigen::VectorXd& r) const override;
+
+    int numLevels() const { return _operators.size(); }
+
+private:
+    void vcycle(int level, const Eigen::VectorXd& b, Eigen::VectorXd& x) const;
+
+    std::vector<Eigen::SparseMatrix<double> > _prolongators;
+    std::vector<Eigen::SparseMatrix<double> > _restrictions;
+    std::vector<Eigen::SparseMatrix<double> > _levelOperators;
+    std::vector<Eigen::SparseMatrix<double> > _operators;     // coarsest first, the last one is the fine matrix
+    int _smoothingSteps;
+    bool _isVerbose;    // print the hierarchy used by every compute
+    Eigen::SimplicialLDLT<Eigen::SparseMatrix<double> > _coarseSolver;
+};
+
+// stationary iterations x += M (b - A x) with a preconditioner M, e.g. multigrid V-cycles used as the solver itself. A solve
+// that stops above the tolerance (or diverges) is reported by isIndefiniteDetected, so that the callers fall back as for PCG
+class PreconditionedIterationSolver : public LinearSolver
+{
+public:
+    PreconditionedIterationSolver(std::shared_ptr<Preconditioner> precon, double tol = 1e-8, int maxIter = 100) : _precon(precon), _tol(tol), _maxIter(maxIter) {}
+
+    virtual std::string name() const override { return _precon->name() + " iterations"; }
+    virtual void analyzePattern(const Eigen::SparseMatrix<double>& A) override {}
+    virtual bool factorize(const Eigen::SparseMatrix<double>& A) override
+    {
+        _A = A;
+        return _precon->compute(_A);
+    }
+    virtual Eigen::VectorXd solve(const Eigen::VectorXd& rhs) override;
+    virtual bool isIterative() const override { return true; }
+    virtual bool isIndefiniteDetected() const override { return !isConverged(); }
+
+    int lastIterations() const { return _lastIters; }
+    double lastRelativeResidual() const { return _lastRelRes; }
+    bool isConverged() const { return _lastRelRes <= _tol; }
+
+private:
+    std::shared_ptr<Preconditioner> _precon;
+    double _tol;
+    int _maxIter;
+    Eigen::SparseMatrix<double> _A;
+    int _lastIters = 0;
+    double _lastRelRes = 0;
+};
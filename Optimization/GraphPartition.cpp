@@ -0,0 +1,371 @@
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <queue>
+#include <cmath>
+#include "GraphPartition.h"
+
+static PartitionGraph withWeights(const PartitionGraph& graph)
+{
+    PartitionGraph g = graph;
+    if (g.adjwgt.empty())
+        g.adjwgt.assign(g.adjncy.size(), 1);
+    if (g.vwgt.empty())
+        g.vwgt.assign(g.numVertices(), 1);
+    return g;
+}
+
+// heavy-edge matching: every vertex is merged with its unmatched neighbor of largest edge weight, cmap maps the fine
+// vertices to the coarse ones
+static PartitionGraph coarsen(const PartitionGraph& g, std::vector<int>& cmap, std::mt19937& rng)
+{
+    int n = g.numVertices();
+    std::vector<int> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin(), order.end(), rng);
+
+    cmap.assign(n, -1);
+    std::vector<int> members0, members1;
+    for (int v : order)
+    {
+        if (cmap[v] >= 0)
+            continue;
+        int best = v;
+        int bestWeight = -1;
+        for (int k = g.xadj[v]; k < g.xadj[v + 1]; k++)
+        {
+            int u = g.adjncy[k];
+            if (u != v && cmap[u] < 0 && g.adjwgt[k] > bestWeight)
+            {
+                best = u;
+                bestWeight = g.adjwgt[k];
+            }
+        }
+        cmap[v] = cmap[best] = members0.size();
+        members0.push_back(v);
+        members1.push_back(best != v ? best : -1);
+    }
+
+    int nc = members0.size();
+    PartitionGraph c;
+    c.xadj.assign(nc + 1, 0);
+    c.vwgt.assign(nc, 0);
+    std::vector<int> marker(nc, -1);    // position of a coarse neighbor in the current row
+    for (int cv = 0; cv < nc; cv++)
+    {
+        int rowStart = c.adjncy.size();
+        for (int v : { members0[cv], members1[cv] })
+        {
+            if (v < 0)
+                continue;
+            c.vwgt[cv] += g.vwgt[v];
+            for (int k = g.xadj[v]; k < g.xadj[v + 1]; k++)
+            {
+                int cu = cmap[g.adjncy[k]];
+                if (cu == cv)
+                    continue;
+                if (marker[cu] >= rowStart)
+                    c.adjwgt[marker[cu]] += g.adjwgt[k];
+                else
+                {
+                    marker[cu] = c.adjncy.size();
+                    c.adjncy.push_back(cu);
+                    c.adjwgt.push_back(g.adjwgt[k]);
+                }
+            }
+        }
+        c.xadj[cv + 1] = c.adjncy.size();
+    }
+    return c;
+}
+
+static int partWeight(const PartitionGraph& g, const std::vector<int>& part, int side)
+{
+    int w = 0;
+    for (int v = 0; v < g.numVertices(); v++)
+        if (part[v] == side)
+            w += g.vwgt[v];
+    return w;
+}
+
+// gain of moving v to the other side: the cut edges it removes minus the ones it creates
+static int moveGain(const PartitionGraph& g, const std::vector<int>& part, int v, bool& isBoundary)
+{
+    int external = 0, internal = 0;
+    for (int k = g.xadj[v]; k < g.xadj[v + 1]; k++)
+    {
+        if (part[g.adjncy[k]] == part[v])
+            internal += g.adjwgt[k];
+        else
+            external += g.adjwgt[k];
+    }
+    isBoundary = external > 0;
+    return external - internal;
+}
+
+// restore the balance by moving the best boundary vertices off the heavy side, then refine the cut
+static void refineBisection(const PartitionGraph& g, std::vector<int>& part, double target0, double tol)
+{
+    int n = g.numVertices();
+    double w0 = partWeight(g, part, 0);
+
+    for (int pass = 0; pass < 10 && std::abs(w0 - target0) > tol; pass++)
+    {
+        int heavy = w0 > target0 ? 0 : 1;
+        std::vector<std::pair<int, int> > candidates;
+        for (int v = 0; v < n; v++)
+        {
+            bool isBoundary;
+            int gain = moveGain(g, part, v, isBoundary);
+            if (part[v] == heavy && isBoundary)
+                candidates.push_back({ -gain, v });
+        }
+        if (candidates.empty())
+        {
+            // disconnected sides, any vertex of the heavy side may move
+            for (int v = 0; v < n; v++)
+                if (part[v] == heavy)
+                    candidates.push_back({ 0, v });
+        }
+        std::sort(candidates.begin(), candidates.end());
+        for (const auto& c : candidates)
+        {
+            if (std::abs(w0 - target0) <= tol)
+                break;
+            int v = c.second;
+            double newW0 = heavy == 0 ? w0 - g.vwgt[v] : w0 + g.vwgt[v];
+            if (std::abs(newW0 - target0) >= std::abs(w0 - target0))
+                continue;
+            part[v] = 1 - heavy;
+            w0 = newW0;
+        }
+    }
+
+    // Fiduccia-Mattheyses passes: move the unlocked vertex of best gain (even a negative one) that keeps the balance, and
+    // roll back to the best cut of the pass
+    const int maxMovesWithoutImprovement = 100;
+    std::vector<int> gains(n);
+    for (int pass = 0; pass < 10; pass++)
+    {
+        std::priority_queue<std::pair<int, int> > heap;
+        for (int v = 0; v < n; v++)
+        {
+            bool isBoundary;
+            gains[v] = moveGain(g, part, v, isBoundary);
+            if (isBoundary)
+                heap.push({ gains[v], v });
+        }
+
+        std::vector<bool> isLocked(n, false);
+        std::vector<int> moves;
+        int cutChange = 0, bestCutChange = 0;
+        int bestNumMoves = 0;
+        while (!heap.empty() && int(moves.size()) - bestNumMoves < maxMovesWithoutImprovement)
+        {
+            auto top = heap.top();
+            heap.pop();
+            int v = top.second;
+            if (isLocked[v] || top.first != gains[v])
+                continue;
+            double newW0 = part[v] == 0 ? w0 - g.vwgt[v] : w0 + g.vwgt[v];
+            if (std::abs(newW0 - target0) > tol)
+                continue;
+
+            part[v] = 1 - part[v];
+            w0 = newW0;
+            isLocked[v] = true;
+            moves.push_back(v);
+            cutChange -= gains[v];
+            if (cutChange < bestCutChange)
+            {
+                bestCutChange = cutChange;
+                bestNumMoves = moves.size();
+            }
+            for (int k = g.xadj[v]; k < g.xadj[v + 1]; k++)
+            {
+                int u = g.adjncy[k];
+                if (isLocked[u])
+                    continue;
+                bool isBoundary;
+                gains[u] = moveGain(g, part, u, isBoundary);
+                if (isBoundary)
+                    heap.push({ gains[u], u });
+            }
+        }
+
+        for (int i = int(moves.size()) - 1; i >= bestNumMoves; i--)
+        {
+            int v = moves[i];
+            w0 += part[v] == 0 ? -g.vwgt[v] : g.vwgt[v];
+            part[v] = 1 - part[v];
+        }
+        if (bestNumMoves == 0)
+            break;
+    }
+}
+
+// breadth-first growing of side 0 from the seed until it holds the target weight
+static std::vector<int> growBisection(const PartitionGraph& g, int seed, double target0)
+{
+    int n = g.numVertices();
+    std::vector<int> part(n, 1);
+    std::vector<bool> isVisited(n, false);
+    std::queue<int> front;
+    front.push(seed);
+    isVisited[seed] = true;
+    double w0 = 0;
+    int nextUnvisited = 0;
+    while (w0 < target0)
+    {
+        if (front.empty())
+        {
+            // the graph is disconnected, continue from another component
+            while (nextUnvisited < n && isVisited[nextUnvisited])
+                nextUnvisited++;
+            if (nextUnvisited == n)
+                break;
+            front.push(nextUnvisited);
+            isVisited[nextUnvisited] = true;
+        }
+        int v = front.front();
+        front.pop();
+        part[v] = 0;
+        w0 += g.vwgt[v];
+        for (int k = g.xadj[v]; k < g.xadj[v + 1]; k++)
+        {
+            int u = g.adjncy[k];
+            if (!isVisited[u])
+            {
+                isVisited[u] = true;
+                front.push(u);
+            }
+        }
+    }
+    return part;
+}
+
+static std::vector<int> multilevelBisection(const PartitionGraph& g, double fraction, double imbalance, std::mt19937& rng)
+{
+    const int coarsestSize = 100;
+    const int numTrials = 4;
+
+    int n = g.numVertices();
+    double totalWeight = std::accumulate(g.vwgt.begin(), g.vwgt.end(), 0.0);
+    double target0 = fraction * totalWeight;
+    double tol = std::max(imbalance * totalWeight, double(*std::max_element(g.vwgt.begin(), g.vwgt.end())));
+
+    std::vector<int> part;
+    std::vector<int> cmap;
+    PartitionGraph c;
+    if (n > coarsestSize)
+        c = coarsen(g, cmap, rng);
+
+    if (n > coarsestSize && c.numVertices() < 0.95 * n)
+    {
+        std::vector<int> coarsePart = multilevelBisection(c, fraction, imbalance, rng);
+        part.resize(n);
+        for (int v = 0; v < n; v++)
+            part[v] = coarsePart[cmap[v]];
+        refineBisection(g, part, target0, tol);
+    }
+    else
+    {
+        // coarsest graph: keep the best of a few grown and refined bisections
+        int bestCut = -1;
+        std::uniform_int_distribution<int> pick(0, n - 1);
+        for (int trial = 0; trial < numTrials; trial++)
+        {
+            std::vector<int> trialPart = growBisection(g, pick(rng), target0);
+            refineBisection(g, trialPart, target0, tol);
+            int cut = edgeCut(g, trialPart);
+            if (bestCut < 0 || cut < bestCut)
+            {
+                bestCut = cut;
+                part = trialPart;
+            }
+        }
+    }
+    return part;
+}
+
+// subgraph induced by the vertices on the given side, ids keeps the original vertex ids
+static PartitionGraph inducedSubgraph(const PartitionGraph& g, const std::vector<int>& part, int side, const std::vector<int>& ids, std::vector<int>& subIds)
+{
+    int n = g.numVertices();
+    std::vector<int> localId(n, -1);
+    subIds.clear();
+    for (int v = 0; v < n; v++)
+        if (part[v] == side)
+        {
+            localId[v] = subIds.size();
+            subIds.push_back(ids[v]);
+        }
+
+    PartitionGraph sub;
+    sub.xadj.push_back(0);
+    for (int v = 0; v < n; v++)
+    {
+        if (part[v] != side)
+            continue;
+        sub.vwgt.push_back(g.vwgt[v]);
+        for (int k = g.xadj[v]; k < g.xadj[v + 1]; k++)
+        {
+            int u = localId[g.adjncy[k]];
+            if (u >= 0)
+            {
+                sub.adjncy.push_back(u);
+                sub.adjwgt.push_back(g.adjwgt[k]);
+            }
+        }
+        sub.xadj.push_back(sub.adjncy.size());
+    }
+    return sub;
+}
+
+static void recursiveBisection(const PartitionGraph& g, const std::vector<int>& ids, int numParts, int firstPart, double imbalance, std::mt19937& rng, std::vector<int>& parts)
+{
+    if (numParts == 1 || g.numVertices() <= 1)
+    {
+        for (int id : ids)
+            parts[id] = firstPart;
+        return;
+    }
+    int numParts0 = numParts / 2;
+    std::vector<int> part = multilevelBisection(g, double(numParts0) / numParts, imbalance, rng);
+    for (int side = 0; side < 2; side++)
+    {
+        std::vector<int> subIds;
+        PartitionGraph sub = inducedSubgraph(g, part, side, ids, subIds);
+        if (side == 0)
+            recursiveBisection(sub, subIds, numParts0, firstPart, imbalance, rng, parts);
+        else
+            recursiveBisection(sub, subIds, numParts - numParts0, firstPart + numParts0, imbalance, rng, parts);
+    }
+}
+
+std::vector<int> partitionGraph(const PartitionGraph& graph, int numParts, double imbalance)
+{
+    PartitionGraph g = withWeights(graph);
+    int n = g.numVertices();
+    std::vector<int> parts(n, 0);
+    if (n == 0 || numParts <= 1)
+        return parts;
+
+    std::vector<int> ids(n);
+    std::iota(ids.begin(), ids.end(), 0);
+    // the imbalance compounds over the levels of the recursion
+    double levelImbalance = imbalance / std::max(1.0, std::ceil(std::log2(double(numParts))));
+    std::mt19937 rng(5489u);
+    recursiveBisection(g, ids, numParts, 0, levelImbalance, rng, parts);
+    return parts;
+}
+
+int edgeCut(const PartitionGraph& graph, const std::vector<int>& parts)
+{
+    int cut = 0;
+    for (int v = 0; v < graph.numVertices(); v++)
+        for (int k = graph.xadj[v]; k < graph.xadj[v + 1]; k++)
+            if (parts[graph.adjncy[k]] != parts[v])
+                cut += graph.adjwgt.empty() ? 1 : graph.adjwgt[k];
+    return cut / 2;
+}
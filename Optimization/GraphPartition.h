@@ -0,0 +1,24 @@
+#pragma once
+#include <vector>
+
+/*
+ * Multilevel k-way graph partitioning by recursive bisection, in the spirit of METIS (Karypis and Kumar): each bisection
+ * coarsens the graph by heavy-edge matching, splits the coarsest graph by greedy graph growing, and refines the cut with
+ * boundary Fiduccia-Mattheyses passes while projecting back. The graph is undirected, given in CSR form (xadj, adjncy)
+ * with both directions of every edge stored.
+ */
+struct PartitionGraph
+{
+    std::vector<int> xadj;      // size n + 1
+    std::vector<int> adjncy;
+    std::vector<int> adjwgt;    // edge weights, 1 if empty
+    std::vector<int> vwgt;      // vertex weights, 1 if empty
+
+    int numVertices() const { return xadj.empty() ? 0 : int(xadj.size()) - 1; }
+};
+
+// part id in [0, numParts) of every vertex, the parts have balanced vertex weights up to the imbalance tolerance
+std::vector<int> partitionGraph(const PartitionGraph& graph, int numParts, double imbalance = 0.03);
+
+// number of (weighted) edges between different parts
+int edgeCut(const PartitionGraph& graph, const std::vector<int>& parts);
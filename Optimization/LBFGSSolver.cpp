@@ -0,0 +1,180 @@
+#include <fstream>
+#include <iomanip>
+#include <deque>
+#include "LineSearch.h"
+#include "LBFGSSolver.h"
+#include "../Common/Timer.h"
+
+void OptSolver::lbfgsSolver(std::function<double(const Eigen::VectorXd&, Eigen::VectorXd*, Eigen::SparseMatrix<double>*, bool)> objFunc, Eigen::VectorXd& x0, int numIter, double gradTol, double xTol, double fTol, bool disPlayInfo, std::function<void(const Eigen::VectorXd&, double&, double&)> getNormFunc, std::function<double(const Eigen::VectorXd&, const Eigen::VectorXd&)> findMaxStep, std::string* savingFolder, std::function<void(const Eigen::VectorXd&, std::string*)> saveProcess, const LBFGSSolverOptions& options)
+{
+	const int DIM = x0.rows();
+	Eigen::VectorXd grad = Eigen::VectorXd::Zero(DIM);
+	std::deque<Eigen::VectorXd> sList, yList;
+	std::deque<double> rhoList;
+
+	Timer totalTimer;
+	double totalGradTime = 0;
+	double totalPreconTime = 0;
+	double totalLineSearchTime = 0;
+	int totalLineSearchEvals = 0;
+	totalTimer.start();
+
+	std::ofstream optInfo;
+	if (savingFolder)
+	{
+		optInfo = std::ofstream((*savingFolder) + "optInfo.txt");
+		optInfo << "L-BFGS solver with termination criterion: " << std::endl;
+		std::cout << "gradient tol: " << gradTol << ", function update tol: " << fTol << ", variable update tol: " << xTol << ", maximum iteration: " << numIter << ", history size: " << options.historySize << std::endl << std::endl;
+	}
+
+	// H0^{-1} q: the fixed factorization if given, otherwise the usual scaled identity s^T y / y^T y
+	auto applyInitialHessianInverse = [&](const Eigen::VectorXd& q)
+	{
+		if (options.initialHessianInverse)
+			return Eigen::VectorXd(options.initialHessianInverse->apply(q));
+		if (sList.empty())
+			return Eigen::VectorXd(q / std::max(1.0, q.norm()));
+		return Eigen::VectorXd(sList.back().dot(yList.back()) / yList.back().squaredNorm() * q);
+	};
+
+	Timer localTimer;
+	localTimer.start();
+	double f = objFunc(x0, &grad, NULL, false);
+	localTimer.stop();
+	totalGradTime += localTimer.elapsedSeconds();
+
+	int i = 0;
+	for (; i < numIter; i++)
+	{
+		if (disPlayInfo)
+			std::cout << "\niter: " << i << std::endl;
+		if (savingFolder)
+			optInfo << "\niter: " << i << std::endl;
+
+		// two-loop recursion
+		localTimer.start();
+		int m = sList.size();
+		std::vector<double> alphas(m);
+		Eigen::VectorXd q = grad;
+		for (int k = m - 1; k >= 0; k--)
+		{
+			alphas[k] = rhoList[k] * sList[k].dot(q);
+			q -= alphas[k] * yList[k];
+		}
+		Eigen::VectorXd r = applyInitialHessianInverse(q);
+		for (int k = 0; k < m; k++)
+		{
+			double beta = rhoList[k] * yList[k].dot(r);
+			r += (alphas[k] - beta) * sList[k];
+		}
+		Eigen::VectorXd dir = -r;
+		if (dir.dot(grad) >= 0)
+		{
+			if (disPlayInfo)
+				std::cout << "not a descent direction, reset the history." << std::endl;
+			sList.clear();
+			yList.clear();
+			rhoList.clear();
+			dir = -applyInitialHessianInverse(grad);
+		}
+		localTimer.stop();
+		totalPreconTime += localTimer.elapsedSeconds();
+
+		double maxStepSize = findMaxStep ? findMaxStep(x0, dir) : 1.0;
+
+		localTimer.start();
+		int numEvals = 0;
+		double rate = LineSearch::armijo(options.lineSearch, x0, f, grad, dir, objFunc, maxStepSize, options.lineSearchMaxEvals, &numEvals);
+		totalLineSearchEvals += numEvals;
+		localTimer.stop();
+		totalLineSearchTime += localTimer.elapsedSeconds();
+
+		Eigen::VectorXd s = rate * dir;
+		x0 = x0 + s;
+
+		Eigen::VectorXd newGrad;
+		localTimer.start();
+		double fnew = objFunc(x0, &newGrad, NULL, false);
+		localTimer.stop();
+		totalGradTime += localTimer.elapsedSeconds();
+
+		// only keep the pairs with enough positive curvature, so that the update stays positive definite
+		Eigen::VectorXd y = newGrad - grad;
+		double sy = s.dot(y);
+		if (sy > 1e-10 * s.norm() * y.norm())
+		{
+			sList.push_back(s);
+			yList.push_back(y);
+			rhoList.push_back(1.0 / sy);
+			if (sList.size() > options.historySize)
+			{
+				sList.pop_front();
+				yList.pop_front();
+				rhoList.pop_front();
+			}
+		}
+		grad = newGrad;
+
+		if (disPlayInfo)
+		{
+			std::cout << "line search rate : " << rate << ", energy evaluations : " << numEvals << ", history size: " << sList.size() << std::endl;
+			std::cout << "f_old: " << f << ", f_new: " << fnew << ", grad norm: " << grad.norm() << ", delta x: " << s.norm() << ", delta_f: " << f - fnew << std::endl;
+			if (getNormFunc)
+			{
+				double gradz, gradw;
+				getNormFunc(grad, gradz, gradw);
+
+				double updatez, updatew;
+				getNormFunc(s, updatez, updatew);
+				std::cout << "z grad: " << gradz << ", w grad: " << gradw << ", z change: " << updatez << ", w change: " << updatew << std::endl;
+			}
+			std::cout << "timing info (in total seconds): " << std::endl;
+			std::cout << "gradient took: " << totalGradTime << ", two-loop recursion took: " << totalPreconTime << ", line search took: " << totalLineSearchTime << std::endl;
+		}
+		if (savingFolder)
+		{
+			optInfo << "line search rate : " << rate << ", energy evaluations : " << numEvals << ", history size: " << sList.size() << std::endl;
+			optInfo << "f_old: " << f << ", f_new: " << fnew << ", grad norm: " << grad.norm() << ", delta x: " << s.norm() << ", delta_f: " << f - fnew << std::endl;
+		}
+		if (saveProcess && i % 50 == 0)
+			saveProcess(x0, savingFolder);
+
+		double fold = f;
+		f = fnew;
+
+		// termination criteria
+		if (rate < 1e-8)
+		{
+			std::cout << "terminate with small line search rate (<1e-8): L2-norm = " << grad.norm() << std::endl;
+			break;
+		}
+		if (grad.norm() < gradTol)
+		{
+			std::cout << "terminate with gradient L2-norm = " << grad.norm() << std::endl;
+			break;
+		}
+		if (s.norm() < xTol)
+		{
+			std::cout << "terminate with small variable change, gradient L2-norm = " << grad.norm() << std::endl;
+			break;
+		}
+		if (fold - fnew < fTol)
+		{
+			std::cout << "terminate with small energy change, gradient L2-norm = " << grad.norm() << std::endl;
+			break;
+		}
+	}
+
+	if (i >= numIter && disPlayInfo)
+		std::cout << "terminate with reaching the maximum iteration, with gradient L2-norm = " << grad.norm() << std::endl;
+
+	totalTimer.stop();
+	if (disPlayInfo)
+	{
+		std::cout << "end up with energy: " << f << ", gradient: " << grad.norm() << std::endl;
+		std::cout << "total time costed (s): " << totalTimer.elapsedSeconds() << ", within that, gradient took: " << totalGradTime << ", two-loop recursion took: " << totalPreconTime << ", line search took: " << totalLineSearchTime << std::endl;
+		std::cout << "line search (" << options.lineSearch << ") energy evaluations: " << totalLineSearchEvals << std::endl;
+	}
+	if (saveProcess)
+		saveProcess(x0, savingFolder);
+}
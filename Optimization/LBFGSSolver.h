@@ -0,0 +1,22 @@
+#pragma once
+
+#include <iostream>
+#include <memory>
+#include <Eigen/Sparse>
+#include <Eigen/Dense>
+#include <Eigen/Core>
+#include "LinearSolver.h"
+
+struct LBFGSSolverOptions
+{
+	int historySize = 10;	// number of (s, y) pairs kept
+	std::shared_ptr<Preconditioner> initialHessianInverse = nullptr;	// H0^{-1} of the two-loop recursion, scaled identity if not set
+	std::string lineSearch = "backtracking";	// "backtracking" or "interpolation", see LineSearch.h
+	int lineSearchMaxEvals = 50;	// energy evaluations allowed per line search
+};
+
+namespace OptSolver
+{
+	// L-BFGS with the same objective signature as newtonSolver (the hessian is never requested), Armijo backtracking and the optional max step hook
+	void lbfgsSolver(std::function<double(const Eigen::VectorXd&, Eigen::VectorXd*, Eigen::SparseMatrix<double>*, bool)> objFunc, Eigen::VectorXd& x0, int numIter = 1000, double gradTol = 1e-14, double xTol = 0, double fTol = 0, bool displayInfo = true, std::function<void(const Eigen::VectorXd&, double&, double&)> getNormFunc = nullptr, std::function<double(const Eigen::VectorXd&, const Eigen::VectorXd&)> findMaxStep = nullptr, std::string *savingFolder = nullptr, std::function<void(const Eigen::VectorXd&, std::string*)> saveProcess = nullptr, const LBFGSSolverOptions& options = LBFGSSolverOptions());
+}
@@ -1,8 +1,8 @@
-
 #include "LineSearch.h"
 #include <iostream>
+#include <cmath>
 
-double LineSearch::backtrackingArmijo(const Eigen::VectorXd& x, const Eigen::VectorXd& grad, const Eigen::VectorXd& dir, std::function<double(const Eigen::VectorXd&, Eigen::VectorXd*, Eigen::SparseMatrix<double>*, bool)> objFunc, const double alphaInit)
+double LineSearch::backtrackingArmijo(const Eigen::VectorXd& x, const Eigen::VectorXd& grad, const Eigen::VectorXd& dir, std::function<double(const Eigen::VectorXd&, Eigen::VectorXd*, Eigen::SparseMatrix<double>*, bool)> objFunc, const double alphaInit, int maxEvals, int* numEvals)
 {
     const double c = 0.2;
     const double rho = 0.5;
@@ -12,12 +12,98 @@ double LineSearch::backtrackingArmijo(const Eigen::VectorXd& x, const Eigen::Vec
     double fNew = objFunc(xNew, NULL, NULL, false);
     double f = objFunc(x, NULL, NULL, false);
     const double cache = c * grad.dot(dir);
+    int evals = 2;
 
-    while (fNew > f + alpha * cache) {
+    // the trial with the lowest f, returned when the budget runs out before the Armijo condition holds
+    double bestAlpha = 0, bestF = f;
+    while (!(fNew <= f + alpha * cache)) {
+        if (fNew < bestF) {
+            bestAlpha = alpha;
+            bestF = fNew;
+        }
+        if (evals >= maxEvals) {
+            alpha = bestAlpha;
+            break;
+        }
         alpha *= rho;
         xNew = x + alpha * dir;
         fNew = objFunc(xNew, NULL, NULL, false);
+        evals++;
     }
 
+    if (numEvals)
+        *numEvals = evals;
     return alpha;
 }
+
+double LineSearch::interpolatingArmijo(const Eigen::VectorXd& x, double f, const Eigen::VectorXd& grad, const Eigen::VectorXd& dir, std::function<double(const Eigen::VectorXd&, Eigen::VectorXd*, Eigen::SparseMatrix<double>*, bool)> objFunc, const double alphaInit, int maxEvals, int* numEvals)
+{
+    const double c = 0.2;
+    const double dphi0 = grad.dot(dir);
+
+    double alpha = alphaInit;
+    double prevAlpha = -1, prevPhi = 0;    // the last finite trial
+    double bestAlpha = 0, bestPhi = f;
+    int evals = 0;
+    while (evals < maxEvals)
+    {
+        double phi = objFunc(x + alpha * dir, NULL, NULL, false);
+        evals++;
+        bool isFinite = std::isfinite(phi);
+        if (isFinite && phi <= f + c * alpha * dphi0)
+        {
+            bestAlpha = alpha;
+            break;
+        }
+        if (isFinite && phi < bestPhi)
+        {
+            bestAlpha = alpha;
+            bestPhi = phi;
+        }
+
+        double alphaNew = 0.1 * alpha;  // the energy blew up (e.g. an inverted face), shrink hard
+        if (isFinite && prevAlpha < 0)
+        {
+            // minimizer of the quadratic through phi(0), phi'(0) and phi(alpha)
+            alphaNew = -dphi0 * alpha * alpha / (2 * (phi - f - dphi0 * alpha));
+        }
+        else if (isFinite)
+        {
+            // minimizer of the cubic through phi(0), phi'(0), phi(alpha) and phi(prevAlpha)
+            double d1 = phi - f - dphi0 * alpha;
+            double d2 = prevPhi - f - dphi0 * prevAlpha;
+            double denom = alpha * alpha * prevAlpha * prevAlpha * (alpha - prevAlpha);
+            double a = (prevAlpha * prevAlpha * d1 - alpha * alpha * d2) / denom;
+            double b = (-prevAlpha * prevAlpha * prevAlpha * d1 + alpha * alpha * alpha * d2) / denom;
+            double disc = b * b - 3 * a * dphi0;
+            if (std::abs(a) < 1e-14 * std::abs(b))
+                alphaNew = -dphi0 / (2 * b);
+            else if (disc >= 0)
+                alphaNew = (-b + std::sqrt(disc)) / (3 * a);
+            else
+                alphaNew = 0.5 * alpha;
+        }
+        if (isFinite)
+        {
+            prevAlpha = alpha;
+            prevPhi = phi;
+        }
+        // safeguard against tiny steps and against steps that barely shrink
+        if (!std::isfinite(alphaNew))
+            alphaNew = 0.5 * alpha;
+        alpha = std::min(std::max(alphaNew, 0.1 * alpha), 0.5 * alpha);
+    }
+
+    if (numEvals)
+        *numEvals = evals;
+    return bestAlpha;
+}
+
+double LineSearch::armijo(const std::string& type, const Eigen::VectorXd& x, double f, const Eigen::VectorXd& grad, const Eigen::VectorXd& dir, std::function<double(const Eigen::VectorXd&, Eigen::VectorXd*, Eigen::SparseMatrix<double>*, bool)> objFunc, const double alphaInit, int maxEvals, int* numEvals)
+{
+    if (type == "interpolation")
+        return interpolatingArmijo(x, f, grad, dir, objFunc, alphaInit, maxEvals, numEvals);
+    if (type != "backtracking")
+        std::cout << "unknown line search " << type << ", use backtracking." << std::endl;
+    return backtrackingArmijo(x, grad, dir, objFunc, alphaInit, maxEvals, numEvals);
+}
@@ -1,8 +1,20 @@
 #pragma once
+#include <functional>
+#include <string>
 #include <Eigen/Dense>
 #include <Eigen/Sparse>
 
 namespace LineSearch
 {
-    double backtrackingArmijo(const Eigen::VectorXd& x, const Eigen::VectorXd& grad, const Eigen::VectorXd& dir, std::function<double(const Eigen::VectorXd& , Eigen::VectorXd*, Eigen::SparseMatrix<double>*, bool)> objFunc, const double alphaInit = 1.0);
+    // halves alpha until the Armijo condition holds, at most maxEvals evaluations of f (their number is returned in numEvals).
+    // When the budget runs out, the trial with the lowest f is returned (0 if none decreased)
+    double backtrackingArmijo(const Eigen::VectorXd& x, const Eigen::VectorXd& grad, const Eigen::VectorXd& dir, std::function<double(const Eigen::VectorXd& , Eigen::VectorXd*, Eigen::SparseMatrix<double>*, bool)> objFunc, const double alphaInit = 1.0, int maxEvals = 50, int* numEvals = nullptr);
+
+    // Armijo backtracking where each trial step minimizes the quadratic (first trial) or cubic interpolant of phi(alpha) = f(x + alpha dir)
+    // through phi(0) = f, phi'(0) = grad.dot(dir) and the last two trials, safeguarded to [0.1, 0.5] of the previous step. f is the
+    // known value at x. When the budget of maxEvals evaluations runs out, the trial with the lowest f is returned (0 if none decreased)
+    double interpolatingArmijo(const Eigen::VectorXd& x, double f, const Eigen::VectorXd& grad, const Eigen::VectorXd& dir, std::function<double(const Eigen::VectorXd&, Eigen::VectorXd*, Eigen::SparseMatrix<double>*, bool)> objFunc, const double alphaInit = 1.0, int maxEvals = 50, int* numEvals = nullptr);
+
+    // "backtracking" or "interpolation", f is the known value at x (only used by the interpolation)
+    double armijo(const std::string& type, const Eigen::VectorXd& x, double f, const Eigen::VectorXd& grad, const Eigen::VectorXd& dir, std::function<double(const Eigen::VectorXd&, Eigen::VectorXd*, Eigen::SparseMatrix<double>*, bool)> objFunc, const double alphaInit, int maxEvals, int* numEvals = nullptr);
 }
@@ -0,0 +1,603 @@
+#include <Eigen/CholmodSupport>
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <tbb/tbb.h>
+#include "LinearSolver.h"
+#include "AMGPreconditioner.h"
+
+Eigen::MatrixXd LinearSolver::solve(const Eigen::MatrixXd& rhs)
+{
+	Eigen::MatrixXd sol(rhs.rows(), rhs.cols());
+	for (int i = 0; i < rhs.cols(); i++)
+		sol.col(i) = solve(Eigen::VectorXd(rhs.col(i)));
+	return sol;
+}
+
+bool LinearSolver::analyzePatternIfChanged(const Eigen::SparseMatrix<double>& A)
+{
+	bool isSame = (A.isCompressed() && A.rows() == _rows && A.nonZeros() == _innerIndex.size() && A.outerSize() + 1 == _outerIndex.size());
+	if (isSame)
+		isSame = std::equal(A.outerIndexPtr(), A.outerIndexPtr() + A.outerSize() + 1, _outerIndex.data()) && std::equal(A.innerIndexPtr(), A.innerIndexPtr() + A.nonZeros(), _innerIndex.data());
+	if (isSame)
+		return false;
+
+	analyzePattern(A);
+	_rows = A.rows();
+	_outerIndex = Eigen::Map<const Eigen::VectorXi>(A.outerIndexPtr(), A.outerSize() + 1);
+	_innerIndex = Eigen::Map<const Eigen::VectorXi>(A.innerIndexPtr(), A.nonZeros());
+	// an uncompressed matrix never matches, so the analysis is simply redone next time
+	if (!A.isCompressed())
+		_rows = -1;
+	return true;
+}
+
+bool LDLTLinearSolver::inertia(int& nPos, int& nNeg, int& nZero) const
+{
+	if (!_isFactorized)
+		return false;
+	Eigen::VectorXd D = _solver.vectorD();
+	double eps = 1e-12 * std::max(1.0, D.cwiseAbs().maxCoeff());
+	nPos = nNeg = nZero = 0;
+	for (int i = 0; i < D.size(); i++)
+	{
+		if (D[i] > eps)
+			nPos++;
+		else if (D[i] < -eps)
+			nNeg++;
+		else
+			nZero++;
+	}
+	return true;
+}
+
+void MixedPrecisionLinearSolver::analyzePattern(const Eigen::SparseMatrix<double>& A)
+{
+	Eigen::SparseMatrix<float> Af = A.cast<float>();
+	_floatSolver.analyzePattern(Af);
+	// the double precision analysis is only run once it is needed, then reused until the pattern changes
+	_isDoubleAnalyzed = _isDoubleFallback;
+	if (_isDoubleFallback)
+		_doubleSolver.analyzePattern(A);
+	_isFactorized = false;
+}
+
+bool MixedPrecisionLinearSolver::factorize(const Eigen::SparseMatrix<double>& A)
+{
+	_A = A;
+	_isDoubleFactorized = false;
+	if (_isDoubleFallback)
+	{
+		_isFactorized = factorizeDouble();
+		return _isFactorized;
+	}
+
+	Eigen::SparseMatrix<float> Af = A.cast<float>();
+	_floatSolver.factorize(Af);
+	_isFactorized = (_floatSolver.info() == Eigen::Success);
+	int nPos = 0, nNeg = 0, nZero = 0;
+	if (_isFactorized && _isSPDRequired)
+	{
+		inertia(nPos, nNeg, nZero);
+		_isFactorized = (nNeg == 0 && nZero == 0);
+	}
+	// clearly negative pivots mean an indefinite matrix, only the (near) singular cases are retried in double precision
+	if (!_isFactorized && nNeg == 0 && factorizeDouble())
+	{
+		// only the single precision rounding broke the factorization
+		std::cout << "single precision factorization failed, fall back to double precision." << std::endl;
+		_isDoubleFallback = true;
+		_isFactorized = true;
+	}
+	return _isFactorized;
+}
+
+bool MixedPrecisionLinearSolver::factorizeDouble()
+{
+	if (!_isDoubleAnalyzed)
+	{
+		_doubleSolver.analyzePattern(_A);
+		_isDoubleAnalyzed = true;
+	}
+	_doubleSolver.factorize(_A);
+	_isDoubleFactorized = (_doubleSolver.info() == Eigen::Success);
+	if (_isDoubleFactorized && _isSPDRequired)
+		_isDoubleFactorized = (_doubleSolver.vectorD().minCoeff() > 0);
+	return _isDoubleFactorized;
+}
+
+Eigen::VectorXd MixedPrecisionLinearSolver::floatSolve(const Eigen::VectorXd& r) const
+{
+	// scale to keep the residual inside the float range
+	double scale = r.cwiseAbs().maxCoeff();
+	if (scale == 0)
+		return Eigen::VectorXd::Zero(r.size());
+	Eigen::VectorXf rf = (r / scale).cast<float>();
+	Eigen::VectorXf xf = _floatSolver.solve(rf);
+	return scale * xf.cast<double>();
+}
+
+Eigen::VectorXd MixedPrecisionLinearSolver::solve(const Eigen::VectorXd& rhs)
+{
+	_lastRefinements = 0;
+	if (_isDoubleFallback)
+	{
+		if (!_isDoubleFactorized)
+			factorizeDouble();
+		return _doubleSolver.solve(rhs);
+	}
+
+	double bnorm = rhs.norm();
+	Eigen::VectorXd x = Eigen::VectorXd::Zero(rhs.size());
+	if (bnorm == 0)
+		return x;
+
+	// iterative refinement
+	Eigen::VectorXd r = rhs;
+	double rnorm = bnorm;
+	for (; _lastRefinements < _maxRefinements; _lastRefinements++)
+	{
+		x += floatSolve(r);
+		r = rhs - _A * x;
+		double rnormNew = r.norm();
+		if (rnormNew <= _tol * bnorm)
+			return x;
+		if (!std::isfinite(rnormNew) || rnormNew > 0.5 * rnorm)
+			break;	// stalled
+		rnorm = rnormNew;
+	}
+
+	// CG preconditioned by the float factor, started from the refined solution
+	if (!std::isfinite(r.norm()))
+	{
+		x.setZero();
+		r = rhs;
+	}
+	Eigen::VectorXd z = floatSolve(r);
+	Eigen::VectorXd p = z;
+	double rz = r.dot(z);
+	for (int i = 0; i < 5 * _maxRefinements; i++)
+	{
+		Eigen::VectorXd Ap = _A * p;
+		double pAp = p.dot(Ap);
+		if (pAp <= 0 || !std::isfinite(pAp))
+			break;
+		double alpha = rz / pAp;
+		x += alpha * p;
+		r -= alpha * Ap;
+		if (r.norm() <= _tol * bnorm)
+		{
+			_lastRefinements += i + 1;
+			return x;
+		}
+		z = floatSolve(r);
+		double rzNew = r.dot(z);
+		p = z + (rzNew / rz) * p;
+		rz = rzNew;
+	}
+
+	std::cout << "mixed precision refinement stalled (relative residual " << r.norm() / bnorm << "), fall back to double precision." << std::endl;
+	_isDoubleFallback = true;
+	factorizeDouble();
+	return _doubleSolver.solve(rhs);
+}
+
+bool MixedPrecisionLinearSolver::inertia(int& nPos, int& nNeg, int& nZero) const
+{
+	if (!_isFactorized)
+		return false;
+	Eigen::VectorXd D = _isDoubleFallback ? _doubleSolver.vectorD() : Eigen::VectorXd(_floatSolver.vectorD().cast<double>());
+	double eps = (_isDoubleFallback ? 1e-12 : 1e-6) * std::max(1.0, D.cwiseAbs().maxCoeff());
+	nPos = nNeg = nZero = 0;
+	for (int i = 0; i < D.size(); i++)
+	{
+		if (D[i] > eps)
+			nPos++;
+		else if (D[i] < -eps)
+			nNeg++;
+		else
+			nZero++;
+	}
+	return true;
+}
+
+bool JacobiPreconditioner::compute(const Eigen::SparseMatrix<double>& A)
+{
+	Eigen::VectorXd diag = A.diagonal();
+	_invDiag.resize(diag.size());
+	bool isPositive = true;
+	for (int i = 0; i < diag.size(); i++)
+	{
+		if (diag[i] <= 0)
+			isPositive = false;
+		_invDiag[i] = diag[i] != 0 ? 1.0 / std::abs(diag[i]) : 1.0;
+	}
+	return isPositive;
+}
+
+BlockJacobiPreconditioner::BlockJacobiPreconditioner(const std::vector<int>& dofGroups)
+{
+	std::vector<int> groupIds;
+	for (int i = 0; i < dofGroups.size(); i++)
+	{
+		if (dofGroups[i] >= (int)groupIds.size())
+			groupIds.resize(dofGroups[i] + 1, -1);
+		if (groupIds[dofGroups[i]] == -1)
+		{
+			groupIds[dofGroups[i]] = _blocks.size();
+			_blocks.push_back({});
+		}
+		_blocks[groupIds[dofGroups[i]]].push_back(i);
+	}
+}
+
+bool BlockJacobiPreconditioner::compute(const Eigen::SparseMatrix<double>& A)
+{
+	if (_blocks.empty())
+	{
+		// no groups given, fall back to scalar blocks
+		for (int i = 0; i < A.rows(); i++)
+			_blocks.push_back({ i });
+	}
+	_invBlocks.resize(_blocks.size());
+	std::atomic<bool> isPositive(true);
+
+	auto invertBlocks = [&](const tbb::blocked_range<uint32_t>& range)
+	{
+		for (uint32_t b = range.begin(); b < range.end(); ++b)
+		{
+			int n = _blocks[b].size();
+			Eigen::MatrixXd block(n, n);
+			for (int i = 0; i < n; i++)
+				for (int j = 0; j < n; j++)
+					block(i, j) = A.coeff(_blocks[b][i], _blocks[b][j]);
+
+			Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> es(block);
+			Eigen::VectorXd evals = es.eigenvalues();
+			double eps = 1e-12 * std::max(1.0, evals.cwiseAbs().maxCoeff());
+			if (evals.minCoeff() <= 0)
+				isPositive = false;
+			for (int i = 0; i < n; i++)
+				evals[i] = 1.0 / std::max(std::abs(evals[i]), eps);
+			_invBlocks[b] = es.eigenvectors() * evals.asDiagonal() * es.eigenvectors().transpose();
+		}
+	};
+	tbb::blocked_range<uint32_t> rangex(0u, (uint32_t)_blocks.size());
+	tbb::parallel_for(rangex, invertBlocks);
+	return isPositive;
+}
+
+Eigen::VectorXd BlockJacobiPreconditioner::apply(const Eigen::VectorXd& r) const
+{
+	Eigen::VectorXd z(r.size());
+	for (int b = 0; b < _blocks.size(); b++)
+	{
+		int n = _blocks[b].size();
+		Eigen::VectorXd rb(n);
+		for (int i = 0; i < n; i++)
+			rb[i] = r[_blocks[b][i]];
+		Eigen::VectorXd zb = _invBlocks[b] * rb;
+		for (int i = 0; i < n; i++)
+			z[_blocks[b][i]] = zb[i];
+	}
+	return z;
+}
+
+bool ICPreconditioner::compute(const Eigen::SparseMatrix<double>& A)
+{
+	// IncompleteCholesky only reads the lower triangular part
+	_ic.compute(A);
+	return _ic.info() == Eigen::Success;
+}
+
+FactorizationPreconditioner::FactorizationPreconditioner(const Eigen::SparseMatrix<double>& M, std::shared_ptr<LinearSolver> solver)
+	: _solver(solver), _dim(M.rows())
+{
+	if (!_solver)
+		_solver = createLinearSolver("auto", M.rows());
+	if (!_solver->compute(M))
+	{
+		// make it definite with a small diagonal shift
+		Eigen::SparseMatrix<double> I(M.rows(), M.cols());
+		I.setIdentity();
+		double shift = 1e-8 * std::max(1.0, M.diagonal().cwiseAbs().maxCoeff());
+		std::cout << "the preconditioner matrix is not positive definite, shift it by " << shift << std::endl;
+		_solver->compute(M + shift * I);
+	}
+}
+
+bool FactorizationPreconditioner::compute(const Eigen::SparseMatrix<double>& A)
+{
+	// nothing to refactorize, only a cheap sanity check of the system
+	if (A.rows() != _dim)
+		std::cout << "the fixed preconditioner has size " << _dim << ", but the system has size " << A.rows() << std::endl;
+	Eigen::VectorXd diag = A.diagonal();
+	return diag.size() == 0 || diag.minCoeff() > 0;
+}
+
+bool SchurComplementLinearSolver::factorize(const Eigen::SparseMatrix<double>& A)
+{
+	int nv = _numPrimary;
+	int ne = A.rows() - nv;
+	_Avv = A.topLeftCorner(nv, nv);
+	_Ave = A.topRightCorner(nv, ne);
+	_Aev = A.bottomLeftCorner(ne, nv);
+	Eigen::SparseMatrix<double> Aee = A.bottomRightCorner(ne, ne);
+
+	Eigen::SparseMatrix<double> S = _Avv;
+	_isExact = true;
+	if (ne > 0)
+	{
+		_eliminatedSolver.compute(Aee);
+		if (_eliminatedSolver.info() != Eigen::Success)
+			return false;
+		_isExact = (Aee.nonZeros() == ne);
+		Eigen::VectorXd invDiag = Aee.diagonal().cwiseInverse();
+		S = _Avv - Eigen::SparseMatrix<double>(_Ave * invDiag.asDiagonal()) * _Aev;
+	}
+	S.makeCompressed();
+
+	if (!_schurSolver)
+		_schurSolver = createLinearSolver("auto", nv);
+	_schurSolver->analyzePatternIfChanged(S);
+	if (_schurSolver->factorize(S))
+		return true;
+	if (_isExact)
+		return false;
+	// the approximate complement can be indefinite, the vertex block is still a valid preconditioner
+	_schurSolver->analyzePatternIfChanged(_Avv);
+	return _schurSolver->factorize(_Avv);
+}
+
+Eigen::VectorXd SchurComplementLinearSolver::solve(const Eigen::VectorXd& rhs)
+{
+	int nv = _numPrimary;
+	int ne = rhs.size() - nv;
+	_lastIters = 0;
+	_lastRelRes = 0;
+	_isFailed = false;
+	if (ne == 0)
+		return _schurSolver->solve(rhs);
+
+	Eigen::VectorXd be = rhs.tail(ne);
+	Eigen::VectorXd g = rhs.head(nv) - _Ave * _eliminatedSolver.solve(be);
+
+	Eigen::VectorXd xv;
+	if (_isExact)
+		xv = _schurSolver->solve(g);
+	else
+	{
+		// PCG on S = Avv - Ave Aee^{-1} Aev
+		xv = Eigen::VectorXd::Zero(nv);
+		Eigen::VectorXd r = g;
+		Eigen::VectorXd z = _schurSolver->solve(r);
+		Eigen::VectorXd p = z;
+		double rz = r.dot(z);
+		double gnorm = g.norm();
+		for (; _lastIters < _maxIter && r.norm() > _tol * gnorm; _lastIters++)
+		{
+			Eigen::VectorXd Sp = _Avv * p - _Ave * _eliminatedSolver.solve(Eigen::VectorXd(_Aev * p));
+			double pSp = p.dot(Sp);
+			if (pSp <= 0)
+			{
+				_isFailed = true;
+				break;
+			}
+			double alpha = rz / pSp;
+			xv += alpha * p;
+			r -= alpha * Sp;
+			z = _schurSolver->solve(r);
+			double rzNew = r.dot(z);
+			p = z + (rzNew / rz) * p;
+			rz = rzNew;
+		}
+		_lastRelRes = gnorm > 0 ? r.norm() / gnorm : 0;
+		if (!(_lastRelRes <= _tol))
+			_isFailed = true;
+	}
+
+	Eigen::VectorXd x(rhs.size());
+	x.head(nv) = xv;
+	x.tail(ne) = _eliminatedSolver.solve(Eigen::VectorXd(be - _Aev * xv));
+	return x;
+}
+
+std::shared_ptr<Preconditioner> createPreconditioner(const std::string& type, const std::vector<int>& dofGroups, const Eigen::MatrixXd& nearNullspace)
+{
+	if (type == "amg")
+		return std::make_shared<AMGPreconditioner>(dofGroups, nearNullspace);
+	else if (type == "block_jacobi")
+		return std::make_shared<BlockJacobiPreconditioner>(dofGroups);
+	else if (type == "ic")
+		return std::make_shared<ICPreconditioner>();
+	else if (type != "jacobi" && type != "")
+		std::cout << "unknown preconditioner: " << type << ", use jacobi instead." << std::endl;
+	return std::make_shared<JacobiPreconditioner>();
+}
+
+PCGLinearSolver::PCGLinearSolver(double tol, int maxIter, std::shared_ptr<Preconditioner> precon)
+	: _tol(tol), _maxIter(maxIter), _precon(precon)
+{
+	if (!_precon)
+		_precon = std::make_shared<JacobiPreconditioner>();
+}
+
+bool PCGLinearSolver::factorize(const Eigen::SparseMatrix<double>& A)
+{
+	_A = A;
+	// a non-positive diagonal entry already rules out positive definiteness, any other indefiniteness is only met by the
+	// solve (isIndefiniteDetected)
+	return _precon->compute(_A);
+}
+
+Eigen::VectorXd PCGLinearSolver::solve(const Eigen::VectorXd& rhs)
+{
+	Eigen::VectorXd x = Eigen::VectorXd::Zero(rhs.size());
+	_lastIters = 0;
+	_lastRelRes = 0;
+	_isNegCurvature = false;
+
+	double bnorm = rhs.norm();
+	if (bnorm == 0)
+		return x;
+
+	Eigen::VectorXd r = rhs;
+	Eigen::VectorXd z = _precon->apply(r);
+	Eigen::VectorXd p = z;
+	double rz = r.dot(z);
+
+	for (; _lastIters < _maxIter; _lastIters++)
+	{
+		_lastRelRes = r.norm() / bnorm;
+		if (_lastRelRes <= _tol)
+			break;
+
+		Eigen::VectorXd Ap = _op ? _op(p) : Eigen::VectorXd(_A * p);
+		double pAp = p.dot(Ap);
+		if (pAp <= 0)
+		{
+			// negative curvature: return the current iterate, or the preconditioned residual if nothing was done yet
+			_isNegCurvature = true;
+			if (_lastIters == 0)
+				x = z;
+			break;
+		}
+		double alpha = rz / pAp;
+		x += alpha * p;
+		r -= alpha * Ap;
+		z = _precon->apply(r);
+		double rzNew = r.dot(z);
+		p = z + (rzNew / rz) * p;
+		rz = rzNew;
+	}
+	return x;
+}
+
+std::shared_ptr<LinearSolver> createLinearSolver(const std::string& type, int dim, double pcgTol, int pcgMaxIter, const std::string& preconditioner, const std::vector<int>& dofGroups, const Eigen::MatrixXd& nearNullspace)
+{
+	std::string solverType = type;
+	if (solverType == "schur")
+	{
+		std::cout << "schur needs the vertex / edge DOF layout of the model, use auto for this system." << std::endl;
+		solverType = "auto";
+	}
+	if (solverType == "" || solverType == "auto")
+	{
+		if (dim < 20000)
+			solverType = "cholmod_simplicial";
+		else if (dim < 1000000)
+			solverType = "cholmod_supernodal";
+		else
+			solverType = "pcg";
+	}
+
+	std::shared_ptr<LinearSolver> solver;
+	if (solverType == "cholmod_supernodal")
+		solver = std::make_shared<DirectLinearSolver<Eigen::CholmodSupernodalLLT<Eigen::SparseMatrix<double> > > >("cholmod_supernodal");
+	else if (solverType == "cholmod_simplicial")
+		solver = std::make_shared<DirectLinearSolver<Eigen::CholmodSimplicialLLT<Eigen::SparseMatrix<double> > > >("cholmod_simplicial");
+	else if (solverType == "eigen_llt")
+		solver = std::make_shared<DirectLinearSolver<Eigen::SimplicialLLT<Eigen::SparseMatrix<double> > > >("eigen_llt");
+	else if (solverType == "eigen_ldlt")
+		solver = std::make_shared<LDLTLinearSolver>();
+	else if (solverType == "mixed_ldlt")
+		solver = std::make_shared<MixedPrecisionLinearSolver>();
+	else if (solverType == "pcg")
+		solver = std::make_shared<PCGLinearSolver>(pcgTol, pcgMaxIter, createPreconditioner(preconditioner, dofGroups, nearNullspace));
+	else
+	{
+		std::cout << "unknown linear solver: " << type << ", use cholmod_supernodal instead." << std::endl;
+		solver = std::make_shared<DirectLinearSolver<Eigen::CholmodSupernodalLLT<Eigen::SparseMatrix<double> > > >("cholmod_supernodal");
+	}
+	std::cout << "linear solver: " << solver->name() << " (" << dim << " DOFs)" << std::endl;
+	return solver;
+}
+
+void CongruenceProduct::analyzePattern(const Eigen::SparseMatrix<double>& H)
+{
+	_outerIndex = Eigen::Map<const Eigen::VectorXi>(H.outerIndexPtr(), H.outerSize() + 1);
+	_innerIndex = Eigen::Map<const Eigen::VectorXi>(H.innerIndexPtr(), H.nonZeros());
+
+	// H(i, j) contributes T(i, a) H(i, j) T(j, b) to (T^T H T)(a, b), for a in row i and b in row j of T
+	struct Term
+	{
+		int row, col, h;
+		double coeff;
+	};
+	std::vector<Term> terms;
+	for (int j = 0; j < H.outerSize(); j++)
+		for (int h = H.outerIndexPtr()[j]; h < H.outerIndexPtr()[j + 1]; h++)
+		{
+			int i = H.innerIndexPtr()[h];
+			for (Eigen::SparseMatrix<double>::InnerIterator ta(_TT, i); ta; ++ta)
+				for (Eigen::SparseMatrix<double>::InnerIterator tb(_TT, j); tb; ++tb)
+					terms.push_back({ (int)ta.row(), (int)tb.row(), h, ta.value() * tb.value() });
+		}
+
+	std::vector<Eigen::Triplet<double> > T(terms.size());
+	for (int s = 0; s < terms.size(); s++)
+		T[s] = Eigen::Triplet<double>(terms[s].row, terms[s].col, 1.0);
+	_pattern.resize(_T.cols(), _T.cols());
+	_pattern.setFromTriplets(T.begin(), T.end());
+	_pattern.makeCompressed();
+
+	// group the terms by the nonzero they sum into
+	int nnz = _pattern.nonZeros();
+	std::vector<int> termToNonzero(terms.size());
+	for (int s = 0; s < terms.size(); s++)
+	{
+		const int* begin = _pattern.innerIndexPtr() + _pattern.outerIndexPtr()[terms[s].col];
+		const int* end = _pattern.innerIndexPtr() + _pattern.outerIndexPtr()[terms[s].col + 1];
+		termToNonzero[s] = std::lower_bound(begin, end, terms[s].row) - _pattern.innerIndexPtr();
+	}
+	_termStart.assign(nnz + 1, 0);
+	for (int s = 0; s < terms.size(); s++)
+		_termStart[termToNonzero[s] + 1]++;
+	for (int k = 0; k < nnz; k++)
+		_termStart[k + 1] += _termStart[k];
+	_termH.resize(terms.size());
+	_termCoeff.resize(terms.size());
+	std::vector<int> fill(_termStart.begin(), _termStart.end() - 1);
+	for (int s = 0; s < terms.size(); s++)
+	{
+		int slot = fill[termToNonzero[s]]++;
+		_termH[slot] = terms[s].h;
+		_termCoeff[slot] = terms[s].coeff;
+	}
+}
+
+void CongruenceProduct::compute(const Eigen::SparseMatrix<double>& H, Eigen::SparseMatrix<double>& result, bool isParallel)
+{
+	Eigen::SparseMatrix<double> compressedH;
+	if (!H.isCompressed())
+	{
+		compressedH = H;
+		compressedH.makeCompressed();
+	}
+	const Eigen::SparseMatrix<double>& Hc = H.isCompressed() ? H : compressedH;
+	bool isSamePattern = _outerIndex.size() == Hc.outerSize() + 1 && _innerIndex.size() == Hc.nonZeros()
+		&& std::equal(Hc.outerIndexPtr(), Hc.outerIndexPtr() + Hc.outerSize() + 1, _outerIndex.data())
+		&& std::equal(Hc.innerIndexPtr(), Hc.innerIndexPtr() + Hc.nonZeros(), _innerIndex.data());
+	if (!isSamePattern)
+		analyzePattern(Hc);
+
+	result = _pattern;
+	double* values = result.valuePtr();
+	const double* hValues = Hc.valuePtr();
+	auto gather = [&](const tbb::blocked_range<uint32_t>& range)
+	{
+		for (uint32_t k = range.begin(); k < range.end(); ++k)
+		{
+			double sum = 0;
+			for (int s = _termStart[k]; s < _termStart[k + 1]; s++)
+				sum += _termCoeff[s] * hValues[_termH[s]];
+			values[k] = sum;
+		}
+	};
+	tbb::blocked_range<uint32_t> nnzRange(0u, (uint32_t)result.nonZeros());
+	if (isParallel)
+		tbb::parallel_for(nnzRange, gather);
+	else
+		gather(nnzRange);
+}
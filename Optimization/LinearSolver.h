@@ -0,0 +1,303 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+#include <Eigen/IterativeLinearSolvers>
+
+/*
+ * Common interface of the sparse symmetric linear solvers used by the Newton-type solvers. The symbolic analysis
+ * (analyzePattern) is separated from the numerical factorization (factorize), so that the solvers can reuse the analysis
+ * as long as the hessian pattern does not change.
+ */
+class LinearSolver
+{
+public:
+    virtual ~LinearSolver() {}
+
+    virtual std::string name() const = 0;
+    virtual void analyzePattern(const Eigen::SparseMatrix<double>& A) = 0;
+    virtual bool factorize(const Eigen::SparseMatrix<double>& A) = 0;     // false if A is not admissible (e.g. not SPD for LLT)
+    virtual Eigen::VectorXd solve(const Eigen::VectorXd& rhs) = 0;
+    virtual Eigen::MatrixXd solve(const Eigen::MatrixXd& rhs);
+
+    // number of positive, negative and zero eigenvalues of the last factorized matrix, false if the backend cannot tell
+    virtual bool inertia(int& nPos, int& nNeg, int& nZero) const { return false; }
+    // true if the last solve met a non-positive curvature, iterative solvers only find out that the matrix is not SPD while solving
+    virtual bool isIndefiniteDetected() const { return false; }
+    virtual bool isIterative() const { return false; }
+
+    bool compute(const Eigen::SparseMatrix<double>& A)
+    {
+        analyzePattern(A);
+        return factorize(A);
+    }
+    // run the symbolic analysis only if the pattern of A differs from the last analyzed one, return true if it ran
+    bool analyzePatternIfChanged(const Eigen::SparseMatrix<double>& A);
+
+protected:
+    Eigen::VectorXi _outerIndex, _innerIndex;   // pattern of the last analyzed matrix
+    int _rows = -1;
+};
+
+// sparse direct solvers
+template <typename EigenSolver>
+class DirectLinearSolver : public LinearSolver
+{
+public:
+    DirectLinearSolver(const std::string& solverName) : _name(solverName) {}
+
+    virtual std::string name() const override { return _name; }
+    virtual void analyzePattern(const Eigen::SparseMatrix<double>& A) override
+    {
+        _solver.analyzePattern(A);
+        _isFactorized = false;
+    }
+    virtual bool factorize(const Eigen::SparseMatrix<double>& A) override
+    {
+        _solver.factorize(A);
+        _dim = A.rows();
+        _isFactorized = (_solver.info() == Eigen::Success);
+        return _isFactorized;
+    }
+    virtual Eigen::VectorXd solve(const Eigen::VectorXd& rhs) override { return _solver.solve(rhs); }
+    virtual Eigen::MatrixXd solve(const Eigen::MatrixXd& rhs) override { return _solver.solve(rhs); }
+
+    // a successful Cholesky factorization certifies the matrix to be positive definite
+    virtual bool inertia(int& nPos, int& nNeg, int& nZero) const override
+    {
+        if (!_isFactorized)
+            return false;
+        nPos = _dim;
+        nNeg = 0;
+        nZero = 0;
+        return true;
+    }
+
+protected:
+    std::string _name;
+    EigenSolver _solver;
+    int _dim = 0;
+    bool _isFactorized = false;
+};
+
+// LDLT accepts indefinite matrices, the inertia is read from the signs of D
+class LDLTLinearSolver : public DirectLinearSolver<Eigen::SimplicialLDLT<Eigen::SparseMatrix<double> > >
+{
+public:
+    LDLTLinearSolver() : DirectLinearSolver("eigen_ldlt") {}
+    virtual bool inertia(int& nPos, int& nNeg, int& nZero) const override;
+};
+
+/*
+ * Mixed precision LDLT: the factorization is done in single precision (half the memory and bandwidth), and the double precision
+ * accuracy is recovered by iterative refinement against the double matrix. If the refinement stalls, CG preconditioned by the
+ * single precision factor takes over, and if that fails too, the matrix is factorized in double precision (and stays so for
+ * the following factorizations, since the matrix is then too ill-conditioned for single precision).
+ */
+class MixedPrecisionLinearSolver : public LinearSolver
+{
+public:
+    MixedPrecisionLinearSolver(double tol = 1e-10, int maxRefinements = 10, bool isPositiveDefiniteRequired = true) : _tol(tol), _maxRefinements(maxRefinements), _isSPDRequired(isPositiveDefiniteRequired) {}
+
+    virtual std::string name() const override { return _isDoubleFallback ? "mixed_ldlt (double fallback)" : "mixed_ldlt"; }
+    virtual void analyzePattern(const Eigen::SparseMatrix<double>& A) override;
+    virtual bool factorize(const Eigen::SparseMatrix<double>& A) override;
+    virtual Eigen::VectorXd solve(const Eigen::VectorXd& rhs) override;
+    virtual bool inertia(int& nPos, int& nNeg, int& nZero) const override;
+
+    int lastRefinements() const { return _lastRefinements; }
+
+private:
+    Eigen::VectorXd floatSolve(const Eigen::VectorXd& r) const;
+    bool factorizeDouble();
+
+    double _tol;
+    int _maxRefinements;
+    bool _isSPDRequired;
+    bool _isDoubleFallback = false;
+    bool _isFactorized = false;
+    int _lastRefinements = 0;
+
+    Eigen::SparseMatrix<double> _A;
+    Eigen::SimplicialLDLT<Eigen::SparseMatrix<float> > _floatSolver;
+    Eigen::SimplicialLDLT<Eigen::SparseMatrix<double> > _doubleSolver;
+    bool _isDoubleAnalyzed = false;
+    bool _isDoubleFactorized = false;
+};
+
+/*
+ * Block elimination of the trailing DOFs (the edge DOFs of the midedge formulations, which the Projection layout puts last):
+ * with A = [Avv Ave; Aev Aee], the vertex system S xv = bv - Ave Aee^{-1} be on the Schur complement S = Avv - Ave Aee^{-1} Aev
+ * is solved first, then xe = Aee^{-1} (be - Aev xv). Aee couples the edges of a face, so S is not formed: PCG runs on the
+ * operator of S, preconditioned by the factorization of Avv - Ave diag(Aee)^{-1} Aev, which has the sparsity of the vertex
+ * system. If Aee is diagonal this is the exact Schur complement and no iteration is needed, otherwise (always for the midedge
+ * meshes) the solver is iterative: a condensed solve that meets a non-positive curvature or does not reach the tolerance is
+ * reported by isIndefiniteDetected, so that the callers fall back as for PCG.
+ */
+class SchurComplementLinearSolver : public LinearSolver
+{
+public:
+    // schurSolver factorizes the vertex system (the "auto" backend if not set)
+    SchurComplementLinearSolver(int numPrimary, double tol = 1e-10, int maxIter = 1000, std::shared_ptr<LinearSolver> schurSolver = nullptr) : _numPrimary(numPrimary), _tol(tol), _maxIter(maxIter), _schurSolver(schurSolver) {}
+
+    virtual std::string name() const override { return _schurSolver ? "schur (" + _schurSolver->name() + ")" : "schur"; }
+    virtual void analyzePattern(const Eigen::SparseMatrix<double>& A) override {}
+    virtual bool factorize(const Eigen::SparseMatrix<double>& A) override;
+    virtual Eigen::VectorXd solve(const Eigen::VectorXd& rhs) override;
+    virtual bool isIndefiniteDetected() const override { return _isFailed || (_schurSolver && _schurSolver->isIndefiniteDetected()); }
+    virtual bool isIterative() const override { return !_isExact || (_schurSolver && _schurSolver->isIterative()); }
+
+    int lastIterations() const { return _lastIters; }
+    double lastRelativeResidual() const { return _lastRelRes; }
+
+private:
+    int _numPrimary;    // the leading DOFs that are kept
+    double _tol;
+    int _maxIter;
+    bool _isExact = false;
+    int _lastIters = 0;
+    double _lastRelRes = 0;
+    bool _isFailed = false;     // the last condensed PCG met a non-positive curvature or ran out of iterations
+
+    Eigen::SparseMatrix<double> _Avv, _Ave, _Aev;
+    Eigen::SimplicialLLT<Eigen::SparseMatrix<double> > _eliminatedSolver;     // Aee
+    std::shared_ptr<LinearSolver> _schurSolver;     // Avv - Ave diag(Aee)^{-1} Aev
+};
+
+// preconditioner interface for the iterative solvers
+class Preconditioner
+{
+public:
+    virtual ~Preconditioner() {}
+    virtual std::string name() const = 0;
+    virtual bool compute(const Eigen::SparseMatrix<double>& A) = 0;
+    virtual Eigen::VectorXd apply(const Eigen::VectorXd& r) const = 0;
+};
+
+class JacobiPreconditioner : public Preconditioner
+{
+public:
+    virtual std::string name() const override { return "jacobi"; }
+    virtual bool compute(const Eigen::SparseMatrix<double>& A) override;
+    virtual Eigen::VectorXd apply(const Eigen::VectorXd& r) const override { return _invDiag.cwiseProduct(r); }
+
+private:
+    Eigen::VectorXd _invDiag;
+};
+
+// block Jacobi over the DOF groups (the 3 coordinates of a vertex, the DOFs of an edge), blocks are inverted through their absolute eigenvalues
+class BlockJacobiPreconditioner : public Preconditioner
+{
+public:
+    BlockJacobiPreconditioner(const std::vector<int>& dofGroups);
+
+    virtual std::string name() const override { return "block_jacobi"; }
+    virtual bool compute(const Eigen::SparseMatrix<double>& A) override;
+    virtual Eigen::VectorXd apply(const Eigen::VectorXd& r) const override;
+
+private:
+    std::vector<std::vector<int> > _blocks;
+    std::vector<Eigen::MatrixXd> _invBlocks;
+};
+
+// incomplete Cholesky with AMD ordering, the diagonal shift is increased until the factorization succeeds
+class ICPreconditioner : public Preconditioner
+{
+public:
+    virtual std::string name() const override { return "ic"; }
+    virtual bool compute(const Eigen::SparseMatrix<double>& A) override;
+    virtual Eigen::VectorXd apply(const Eigen::VectorXd& r) const override { return _ic.solve(r); }
+
+private:
+    Eigen::IncompleteCholesky<double, Eigen::Lower, Eigen::AMDOrdering<int> > _ic;
+};
+
+// fixed preconditioner: the factorization of a given SPD matrix (e.g. the constant bending hessian plus the rest membrane stiffness),
+// computed once at construction and reused for every system
+class FactorizationPreconditioner : public Preconditioner
+{
+public:
+    FactorizationPreconditioner(const Eigen::SparseMatrix<double>& M, std::shared_ptr<LinearSolver> solver = nullptr);
+
+    virtual std::string name() const override { return "fixed " + _solver->name(); }
+    virtual bool compute(const Eigen::SparseMatrix<double>& A) override;
+    virtual Eigen::VectorXd apply(const Eigen::VectorXd& r) const override { return _solver->solve(r); }
+
+private:
+    std::shared_ptr<LinearSolver> _solver;
+    int _dim;
+};
+
+// "jacobi", "block_jacobi", "ic" or "amg" (smoothed aggregation over the DOF groups with the given near-nullspace, see AMGPreconditioner.h)
+std::shared_ptr<Preconditioner> createPreconditioner(const std::string& type, const std::vector<int>& dofGroups = {}, const Eigen::MatrixXd& nearNullspace = Eigen::MatrixXd());
+
+/*
+ * Preconditioned conjugate gradient, stops when ||r|| <= tol * ||b|| or on negative curvature. The matrix passed to factorize
+ * builds the preconditioner and, unless an operator is set, provides the products. With setOperator the products go through
+ * the given (matrix-free) hessian-vector operator instead, and only the preconditioner is built from the matrix.
+ */
+class PCGLinearSolver : public LinearSolver
+{
+public:
+    PCGLinearSolver(double tol = 1e-8, int maxIter = 1000, std::shared_ptr<Preconditioner> precon = nullptr);
+
+    virtual std::string name() const override { return "pcg (" + _precon->name() + ")"; }
+    virtual void analyzePattern(const Eigen::SparseMatrix<double>& A) override {}
+    virtual bool factorize(const Eigen::SparseMatrix<double>& A) override;
+    virtual Eigen::VectorXd solve(const Eigen::VectorXd& rhs) override;
+    virtual bool isIterative() const override { return true; }
+    virtual bool isIndefiniteDetected() const override { return _isNegCurvature; }
+
+    void setOperator(std::function<Eigen::VectorXd(const Eigen::VectorXd&)> op) { _op = op; }
+    void setTolerance(double tol) { _tol = tol; }
+    double tolerance() const { return _tol; }
+    int maxIterations() const { return _maxIter; }
+    std::shared_ptr<Preconditioner> preconditioner() const { return _precon; }
+    int lastIterations() const { return _lastIters; }
+    double lastRelativeResidual() const { return _lastRelRes; }
+    bool isNegativeCurvatureDetected() const { return _isNegCurvature; }
+
+protected:
+    double _tol;
+    int _maxIter;
+    std::shared_ptr<Preconditioner> _precon;
+    Eigen::SparseMatrix<double> _A;
+    std::function<Eigen::VectorXd(const Eigen::VectorXd&)> _op;
+
+    int _lastIters = 0;
+    double _lastRelRes = 0;
+    bool _isNegCurvature = false;
+};
+
+/*
+ * Build the linear solver by name: "cholmod_supernodal", "cholmod_simplicial", "eigen_llt", "eigen_ldlt", "mixed_ldlt", "pcg", or
+ * "auto", which picks the backend from the number of DOFs (simplicial for small systems, supernodal for the medium
+ * ones, and PCG once the Cholesky fill-in no longer fits in memory). The PCG preconditioner is "jacobi", "block_jacobi"
+ * (which needs the DOF groups), "ic" or "amg" (which needs the DOF groups and the near-nullspace). "schur" needs the mesh layout
+ * (buildLinearSolver), here it falls back to "auto".
+ */
+std::shared_ptr<LinearSolver> createLinearSolver(const std::string& type, int dim, double pcgTol = 1e-8, int pcgMaxIter = 1000, const std::string& preconditioner = "jacobi", const std::vector<int>& dofGroups = {}, const Eigen::MatrixXd& nearNullspace = Eigen::MatrixXd());
+
+// T^T H T for a fixed T and a sparse H whose pattern rarely changes (the reduced hessians of linear constraints): the pattern
+// of the product and, for each of its nonzeros, the (H nonzero, T(i, a) T(j, b)) terms it sums are built once per H pattern,
+// then the values are gathered in parallel without a sparse-sparse product
+class CongruenceProduct
+{
+public:
+    CongruenceProduct(const Eigen::SparseMatrix<double>& T) : _T(T), _TT(T.transpose()) {}
+
+    void compute(const Eigen::SparseMatrix<double>& H, Eigen::SparseMatrix<double>& result, bool isParallel = true);
+
+private:
+    void analyzePattern(const Eigen::SparseMatrix<double>& H);
+
+    Eigen::SparseMatrix<double> _T, _TT;
+    Eigen::VectorXi _outerIndex, _innerIndex;   // pattern of the last H
+    Eigen::SparseMatrix<double> _pattern;       // pattern of T^T H T
+    std::vector<int> _termStart;                // CSR-like offsets into the terms, one row per nonzero of the product
+    std::vector<int> _termH;                    // nonzero of H
+    std::vector<double> _termCoeff;             // T(i, a) T(j, b)
+};
@@ -1,13 +1,169 @@
-#include <Eigen/CholmodSupport>
 #include <fstream>
+#include <algorithm>
+#include <limits>
 #include <iomanip>
 #include "LineSearch.h"
 #include "NewtonDescent.h"
 #include "../Common/Timer.h"
 // #include "SuiteSparse_config.h"
 
-void OptSolver::newtonSolver(std::function<double(const Eigen::VectorXd&, Eigen::VectorXd*, Eigen::SparseMatrix<double>*, bool)> objFunc, Eigen::VectorXd& x0, int numIter, double gradTol, double xTol, double fTol, bool disPlayInfo, std::function<void(const Eigen::VectorXd&, double&, double&)> getNormFunc, std::function<double(const Eigen::VectorXd&, const Eigen::VectorXd&)> findMaxStep, std::string* savingFolder, std::function<void(const Eigen::VectorXd&, std::string*)> saveProcess)
+// make sure every diagonal entry is structurally present, so that the diagonal shift never changes the pattern
+static void addStructuralDiagonal(Eigen::SparseMatrix<double>& H)
 {
+	bool isDiagComplete = true;
+	for (int k = 0; k < H.outerSize() && isDiagComplete; k++)
+	{
+		Eigen::SparseMatrix<double>::InnerIterator it(H, k);
+		while (it && it.row() < k)
+			++it;
+		if (!it || it.row() != k)
+			isDiagComplete = false;
+	}
+	if (!isDiagComplete)
+	{
+		Eigen::SparseMatrix<double> I(H.rows(), H.cols());
+		I.setIdentity();
+		H += 0.0 * I;
+	}
+	H.makeCompressed();
+}
+
+// indices of the diagonal entries in valuePtr() of a compressed matrix
+static std::vector<int> diagonalIndices(const Eigen::SparseMatrix<double>& H)
+{
+	std::vector<int> diagIds(H.outerSize(), -1);
+	for (int k = 0; k < H.outerSize(); k++)
+	{
+		const int* begin = H.innerIndexPtr() + H.outerIndexPtr()[k];
+		const int* end = H.innerIndexPtr() + H.outerIndexPtr()[k + 1];
+		const int* it = std::lower_bound(begin, end, k);
+		if (it != end && *it == k)
+			diagIds[k] = it - H.innerIndexPtr();
+	}
+	return diagIds;
+}
+
+// Lanczos estimate of the smallest eigenvalue of H (with full reorthogonalization), residual is the error bound of the Ritz
+// value. A few steps are enough to size the first shift, the Ritz value is only an upper bound of the smallest eigenvalue.
+static double smallestEigenvalueEstimate(const Eigen::SparseMatrix<double>& H, double& residual, int maxIters = 20)
+{
+	int n = H.rows();
+	int m = std::min(maxIters, n);
+	Eigen::MatrixXd V(n, m + 1);
+	Eigen::VectorXd alpha(m), beta(m);
+	Eigen::VectorXd v = Eigen::VectorXd::Ones(n) + 0.1 * Eigen::VectorXd::Random(n);
+	V.col(0) = v.normalized();
+
+	double theta = 0;
+	residual = std::numeric_limits<double>::max();
+	for (int k = 0; k < m; k++)
+	{
+		Eigen::VectorXd w = H * V.col(k);
+		alpha[k] = V.col(k).dot(w);
+		w -= V.leftCols(k + 1) * (V.leftCols(k + 1).transpose() * w);
+		beta[k] = w.norm();
+
+		Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eigs;
+		eigs.computeFromTridiagonal(alpha.head(k + 1), beta.head(k), Eigen::ComputeEigenvectors);
+		theta = eigs.eigenvalues()[0];
+		residual = beta[k] * std::abs(eigs.eigenvectors()(k, 0));
+		if (beta[k] < 1e-14 || residual < 1e-3 * std::abs(theta))
+			break;
+		V.col(k + 1) = w / beta[k];
+	}
+	return theta;
+}
+
+// Gershgorin lower bound of the smallest eigenvalue of a symmetric H: min_i H_ii - sum_{j != i} |H_ij|
+static double gershgorinLowerBound(const Eigen::SparseMatrix<double>& H)
+{
+	double lowerBound = std::numeric_limits<double>::max();
+	for (int k = 0; k < H.outerSize(); k++)
+	{
+		double diag = 0, offDiag = 0;
+		for (Eigen::SparseMatrix<double>::InnerIterator it(H, k); it; ++it)
+		{
+			if (it.row() == k)
+				diag = it.value();
+			else
+				offDiag += std::abs(it.value());
+		}
+		lowerBound = std::min(lowerBound, diag - offDiag);
+	}
+	return lowerBound;
+}
+
+double ForcingTerm::next(double gradNorm, double gradTol)
+{
+	double eta = etaMax;
+	if (_prevGradNorm > 0)
+	{
+		eta = gamma * std::pow(gradNorm / _prevGradNorm, alpha);
+		// do not let the tolerance drop too fast after a lucky step
+		double safeguard = gamma * std::pow(_eta, alpha);
+		if (safeguard > 0.1)
+			eta = std::max(eta, safeguard);
+	}
+	// no point in solving far below what the outer loop asks for
+	if (gradNorm > 0)
+		eta = std::max(eta, 0.5 * gradTol / gradNorm);
+	eta = std::min(std::max(eta, etaMin), etaMax);
+
+	_eta = eta;
+	_prevGradNorm = gradNorm;
+	return eta;
+}
+
+void OptSolver::newtonSolver(std::function<double(const Eigen::VectorXd&, Eigen::VectorXd*, Eigen::SparseMatrix<double>*, bool)> objFunc, Eigen::VectorXd& x0, int numIter, double gradTol, double xTol, double fTol, bool disPlayInfo, std::function<void(const Eigen::VectorXd&, double&, double&)> getNormFunc, std::function<double(const Eigen::VectorXd&, const Eigen::VectorXd&)> findMaxStep, std::string* savingFolder, std::function<void(const Eigen::VectorXd&, std::string*)> saveProcess, const NewtonSolverOptions& options)
+{
+	if (options.constraintBasis.cols() > 0)
+	{
+		// reduced problem f(x0 + T q): gradient T^T g and hessian T^T H T, the constraints hold at every iterate
+		const Eigen::SparseMatrix<double>& T = options.constraintBasis;
+		const Eigen::SparseMatrix<double> TT = T.transpose();
+		const Eigen::VectorXd xBase = x0;
+		CongruenceProduct reducedHessian(T);
+		auto reducedFunc = [&](const Eigen::VectorXd& q, Eigen::VectorXd* grad, Eigen::SparseMatrix<double>* hessian, bool isProj)
+		{
+			Eigen::VectorXd fullGrad;
+			Eigen::SparseMatrix<double> fullHessian;
+			double f = objFunc(xBase + T * q, grad ? &fullGrad : nullptr, hessian ? &fullHessian : nullptr, isProj);
+			if (grad)
+				*grad = TT * fullGrad;
+			if (hessian)
+				reducedHessian.compute(fullHessian, *hessian);
+			return f;
+		};
+		std::function<double(const Eigen::VectorXd&, const Eigen::VectorXd&)> reducedMaxStep = nullptr;
+		if (findMaxStep)
+			reducedMaxStep = [&](const Eigen::VectorXd& q, const Eigen::VectorXd& dq) { return findMaxStep(xBase + T * q, T * dq); };
+		std::function<void(const Eigen::VectorXd&, std::string*)> reducedSave = nullptr;
+		if (saveProcess)
+			reducedSave = [&](const Eigen::VectorXd& q, std::string* folder) { saveProcess(xBase + T * q, folder); };
+
+		NewtonSolverOptions reducedOptions = options;
+		reducedOptions.constraintBasis.resize(0, 0);
+		// the direct solvers and the jacobi / ic preconditioners only depend on the matrix they get, the other ones are laid out
+		// for the full DOFs (DOF groups, near-nullspace, mesh levels, trailing edge DOFs) and are rebuilt for the reduced size
+		PCGLinearSolver* pcg = dynamic_cast<PCGLinearSolver*>(options.linearSolver.get());
+		std::string preconditioner = pcg ? pcg->preconditioner()->name() : "";
+		if (!options.linearSolver)
+			reducedOptions.linearSolver = createLinearSolver("cholmod_supernodal", T.cols());
+		else if (pcg && preconditioner != "jacobi" && preconditioner != "ic")
+			reducedOptions.linearSolver = createLinearSolver("pcg", T.cols(), pcg->tolerance(), pcg->maxIterations(), "jacobi");
+		else if (!pcg && (options.linearSolver->isIterative() || options.linearSolver->name().rfind("schur", 0) == 0))
+			reducedOptions.linearSolver = createLinearSolver("auto", T.cols());
+		if (options.linearSolver && reducedOptions.linearSolver != options.linearSolver)
+			std::cout << options.linearSolver->name() << " is laid out for the full DOFs, the reduced system uses " << reducedOptions.linearSolver->name() << " instead." << std::endl;
+		std::cout << "constrained Newton: " << T.cols() << " master DOFs of " << T.rows() << std::endl;
+
+		// the z/w split of getNormFunc lives on the full DOFs
+		Eigen::VectorXd q = Eigen::VectorXd::Zero(T.cols());
+		newtonSolver(reducedFunc, q, numIter, gradTol, xTol, fTol, disPlayInfo, nullptr, reducedMaxStep, savingFolder, reducedSave, reducedOptions);
+		x0 = xBase + T * q;
+		return;
+	}
+
 	const int DIM = x0.rows(); // not including the clamped DOFs
     //Eigen::VectorXd randomVec = x0;
     //randomVec.setRandom();
@@ -20,6 +176,25 @@ void OptSolver::newtonSolver(std::function<double(const Eigen::VectorXd&, Eigen:
 	double reg = 1e-4;
 
 	bool isProj = true;
+
+	// persistent factorization: analyzePattern runs only when the hessian pattern changes, factorize runs per iteration
+	std::shared_ptr<LinearSolver> solver = options.linearSolver ? options.linearSolver : createLinearSolver("cholmod_supernodal", DIM);
+	std::vector<int> diagIds;
+	double analyzeTime = 0;
+	double totalSavedAnalyzeTime = 0;
+
+	PCGLinearSolver* pcgSolver = dynamic_cast<PCGLinearSolver*>(solver.get());
+	// the solver may be shared with the caller, the forcing terms and the matrix-free operator only last until the solver returns
+	const double pcgTolerance = pcgSolver ? pcgSolver->tolerance() : 0;
+	ForcingTerm forcing;
+	if (options.isInexactNewton)
+	{
+		if (pcgSolver)
+			forcing.etaMin = pcgTolerance;
+		else
+			std::cout << "inexact Newton needs the pcg linear solver, " << solver->name() << " solves exactly." << std::endl;
+	}
+	int totalInnerIters = 0;
 	
     Timer totalTimer;
     double totalAssemblingTime = 0;
@@ -40,6 +215,34 @@ void OptSolver::newtonSolver(std::function<double(const Eigen::VectorXd&, Eigen:
 		std::cout << "energy = 0, return" << std::endl;
 	int i = 0;
 	bool isSmallPerturbNeeded = false;
+	double curShift = 0;
+	double lastF = f;
+	bool isFactorizationReusable = false;
+	int numReusedFactorizations = 0;
+	int totalFactorizations = 0;
+	int totalLineSearchEvals = 0;
+
+	// PCG tolerance from the forcing terms and the matrix-free operator, set once per iteration before the first solve
+	auto configurePCG = [&]()
+	{
+		if (options.isInexactNewton)
+			pcgSolver->setTolerance(forcing.next(grad.norm(), gradTol));
+		// the finite differences give the actual hessian, the projected one (isProj) is only available assembled
+		if (options.isMatrixFreeHessian && isProj)
+			pcgSolver->setOperator(nullptr);
+		else if (options.isMatrixFreeHessian)
+		{
+			// directional derivative of the gradient, the assembled hessian only serves as the preconditioner
+			pcgSolver->setOperator([&](const Eigen::VectorXd& v)
+			{
+				double eps = std::sqrt(std::numeric_limits<double>::epsilon()) * (1.0 + x0.norm()) / std::max(v.norm(), 1e-16);
+				Eigen::VectorXd gradPerturbed;
+				objFunc(x0 + eps * v, &gradPerturbed, NULL, false);
+				return Eigen::VectorXd((gradPerturbed - grad) / eps + curShift * v);
+			});
+		}
+	};
+
 	for (; i < numIter; i++)
 	{
 		if(disPlayInfo)
@@ -47,65 +250,201 @@ void OptSolver::newtonSolver(std::function<double(const Eigen::VectorXd&, Eigen:
 		if(savingFolder)
 			optInfo << "\niter: " << i << std::endl;
         Timer localTimer;
-        localTimer.start(); // assembly time
-		double f = objFunc(x0, &grad, &hessian, isProj);
-        localTimer.stop(); // assembly time
-        double localAssTime = localTimer.elapsedSeconds();
-        totalAssemblingTime += localAssTime;
-
-        localTimer.start(); // solving time
-		Eigen::SparseMatrix<double> H = hessian;
-		Eigen::SparseMatrix<double> I(DIM, DIM);
-		I.setIdentity();
-		if(isSmallPerturbNeeded && isProj)
-			H += reg * I;
-		// linear solve
-		Eigen::CholmodSupernodalLLT<Eigen::SparseMatrix<double>> solver(H);
-		//  Eigen::CholmodSimplicialLLT<Eigen::SparseMatrix<double> > solver(H);
-		//  Eigen::SimplicialLLT<Eigen::SparseMatrix<double> > solver(H);
-		while (solver.info() != Eigen::Success)
+		// modified Newton: keep the last factorization while the full steps keep contracting the gradient
+		bool isReused = options.isLazyHessian && isFactorizationReusable && !isProj;
+		double f = lastF;
+		double localAssTime = 0;
+		bool isSolved = false;	// PCG already solved while checking the factorization
+		if (isReused)
 		{
+			numReusedFactorizations++;
 			if (disPlayInfo)
+				std::cout << "reuse the last factorization, reused " << numReusedFactorizations << " times in total" << std::endl;
+			localTimer.start(); // solving time
+			if (pcgSolver)
+				configurePCG();
+		}
+		else
+		{
+            localTimer.start(); // assembly time
+			f = objFunc(x0, &grad, &hessian, isProj);
+            localTimer.stop(); // assembly time
+            localAssTime = localTimer.elapsedSeconds();
+            totalAssemblingTime += localAssTime;
+
+            localTimer.start(); // solving time
+			addStructuralDiagonal(hessian);
+			Timer analyzeTimer;
+			analyzeTimer.start();
+			// the hessian pattern is fixed unless the contact set changes, so the ordering and symbolic analysis are reused
+			if (solver->analyzePatternIfChanged(hessian))
+			{
+				analyzeTimer.stop();
+				analyzeTime = analyzeTimer.elapsedSeconds();
+				diagIds = diagonalIndices(hessian);
+				if (disPlayInfo)
+					std::cout << "symbolic analysis took: " << analyzeTime << std::endl;
+			}
+			else
+			{
+				totalSavedAnalyzeTime += analyzeTime;
+				if (disPlayInfo)
+					std::cout << "symbolic analysis reused, saved: " << analyzeTime << ", total saved: " << totalSavedAnalyzeTime << std::endl;
+			}
+
+			Eigen::SparseMatrix<double> H = hessian;
+			curShift = 0;
+			auto shiftDiagonal = [&](double shift)
 			{
-				if (isProj){
-					std::cout << "some small perturb is needed to remove round-off error, current reg = " << reg << std::endl;
+				curShift = shift;
+				std::copy(hessian.valuePtr(), hessian.valuePtr() + hessian.nonZeros(), H.valuePtr());
+				for (int k = 0; k < diagIds.size(); k++)
+					H.valuePtr()[diagIds[k]] += shift;
+			};
+			if(isSmallPerturbNeeded && isProj)
+				shiftDiagonal(reg);
+			if (pcgSolver)
+				configurePCG();
+			// linear solve, an indefinite matrix is rejected through the inertia if the backend reports it (LDLT), or by the
+			// solve itself for the iterative solvers, which only meet the negative curvature there
+			int numFactorizations = 0;
+			auto factorizeSPD = [&]()
+			{
+				numFactorizations++;
+				if (!solver->factorize(H))
+					return false;
+				int nPos, nNeg, nZero;
+				if (solver->inertia(nPos, nNeg, nZero) && nNeg + nZero > 0)
+				{
+					if (disPlayInfo)
+						std::cout << "inertia: " << nPos << " positive, " << nNeg << " negative, " << nZero << " zero pivots" << std::endl;
+					return false;
+				}
+				if (solver->isIterative())
+				{
+					delta_x = solver->solve(Eigen::VectorXd(-grad));
+					isSolved = true;
+					if (solver->isIndefiniteDetected())
+					{
+						if (disPlayInfo)
+							std::cout << solver->name() << " stopped on negative curvature or did not converge" << std::endl;
+						return false;
+					}
 				}
-				else
-					std::cout << "Matrix is not positive definite, current reg = " << reg << std::endl;
+				return true;
+			};
+			bool isFactorized = factorizeSPD();
+			// the Gershgorin shift makes H strictly diagonally dominant, hence SPD: the shifts never need to go beyond it
+			double maxShift = std::numeric_limits<double>::max();
+			if (!isFactorized)
+			{
+				// first shift from the smallest eigenvalue estimate rather than doubling reg. The Ritz value overestimates the
+				// smallest eigenvalue, so the shift covers its whole error bound, and is capped by the Gershgorin shift
+				double residual = 0;
+				double lambdaMin = smallestEigenvalueEstimate(hessian, residual);
+				double lowerBound = gershgorinLowerBound(hessian);
+				if (lowerBound < 0)
+					maxShift = -lowerBound * (1 + 1e-8) + 1e-12;
+				if (lambdaMin < 0)
+					reg = std::min(std::max(1.1 * (-lambdaMin + residual), 1e-8), maxShift);
+				if (disPlayInfo)
+					std::cout << "smallest eigenvalue estimate: " << lambdaMin << " (error bound: " << residual << "), Gershgorin bound: " << lowerBound << std::endl;
 			}
+			// each shift costs a factorization, give up on the newton direction after that many
+			const int maxShifts = 60;
+			int numShifts = 0;
+			while (!isFactorized)
+			{
+				if (numShifts++ >= maxShifts)
+				{
+					if (disPlayInfo)
+						std::cout << "no positive definite shift found after " << maxShifts << " factorizations, use the gradient direction." << std::endl;
+					delta_x = -grad;
+					isSolved = true;
+					break;
+				}
+				if (disPlayInfo)
+				{
+					if (isProj){
+						std::cout << "some small perturb is needed to remove round-off error, current reg = " << reg << std::endl;
+					}
+					else
+						std::cout << "Matrix is not positive definite, current reg = " << reg << std::endl;
+				}
 				
-			if(isProj)
-				isSmallPerturbNeeded = true;
-			H = hessian + reg * I;
-			solver.compute(H);
-			reg = std::max(2 * reg, 1e-16);
+				if(isProj)
+					isSmallPerturbNeeded = true;
+				shiftDiagonal(reg);
+				isFactorized = factorizeSPD();
+				// jump to the guaranteed shift rather than doubling past it, keep doubling only if round-off defeats it
+				reg = reg < maxShift ? std::min(std::max(2 * reg, 1e-16), maxShift) : std::max(2 * reg, 1e-16);
 
-            if(reg > 1e4)
-            {
-	            if (disPlayInfo)
-                    std::cout << "reg is too large, use SPD hessian instead." << std::endl;
-                reg = 1e-6;
-                isProj = true;
-                f = objFunc(x0, &grad, &hessian, isProj);
-            }
+                if(reg > 1e4)
+                {
+		            if (disPlayInfo)
+                        std::cout << "reg is too large, use SPD hessian instead." << std::endl;
+                    reg = 1e-6;
+                    maxShift = std::numeric_limits<double>::max();
+                    isProj = true;
+                    f = objFunc(x0, &grad, &hessian, isProj);
+					addStructuralDiagonal(hessian);
+					if (solver->analyzePatternIfChanged(hessian))
+						diagIds = diagonalIndices(hessian);
+					H = hessian;
+					curShift = 0;
+					if (pcgSolver && options.isMatrixFreeHessian)
+						pcgSolver->setOperator(nullptr);	// products with the projected hessian from now on
+                }
+			}
+			totalFactorizations += numFactorizations;
+			if (disPlayInfo)
+				std::cout << "factorizations: " << numFactorizations << ", total: " << totalFactorizations << std::endl;
 		}
 		neggrad = -grad;
-		delta_x = solver.solve(neggrad);
+
+		if (!isSolved)
+			delta_x = solver->solve(neggrad);
+		if (pcgSolver)
+		{
+			totalInnerIters += pcgSolver->lastIterations();
+			if (disPlayInfo)
+				std::cout << "PCG iterations: " << pcgSolver->lastIterations() << " (total: " << totalInnerIters << "), tolerance: " << pcgSolver->tolerance() << ", relative residual: " << pcgSolver->lastRelativeResidual() << (pcgSolver->isNegativeCurvatureDetected() ? ", stopped on negative curvature" : "") << std::endl;
+			if (delta_x.dot(neggrad) <= 0)
+				delta_x = neggrad;
+		}
         localTimer.stop(); // solving time
         double localSolvingTime = localTimer.elapsedSeconds();
         totalSolvingTime += localSolvingTime;
 
+		if (isReused && delta_x.dot(neggrad) <= 0)
+		{
+			if (disPlayInfo)
+				std::cout << "the reused factorization gives no descent direction, take a fresh Newton step." << std::endl;
+			isFactorizationReusable = false;
+			continue;
+		}
+
         if(findMaxStep)
 		    maxStepSize = findMaxStep(x0, delta_x);
         else
             maxStepSize = 1.0;
 
         localTimer.start(); // line search time
-		double rate = LineSearch::backtrackingArmijo(x0, grad, delta_x, objFunc, maxStepSize);
+		int numEvals = 0;
+		double rate = LineSearch::armijo(options.lineSearch, x0, f, grad, delta_x, objFunc, maxStepSize, options.lineSearchMaxEvals, &numEvals);
+		totalLineSearchEvals += numEvals;
         localTimer.stop(); // line search time
         double localLinesearchTime = localTimer.elapsedSeconds();
         totalLineSearchTime += localLinesearchTime;
 
+		if (isReused && rate < 1e-8)
+		{
+			if (disPlayInfo)
+				std::cout << "the reused factorization gives a poor step, take a fresh Newton step." << std::endl;
+			isFactorizationReusable = false;
+			continue;
+		}
+
 		if (!isProj)
 		{
 			reg *= 0.5;
@@ -117,9 +456,16 @@ void OptSolver::newtonSolver(std::function<double(const Eigen::VectorXd&, Eigen:
 		x0 = x0 + rate * delta_x;
 
 		double fnew = objFunc(x0, &grad, NULL, isProj);
+		lastF = fnew;
+		if (options.isLazyHessian)
+		{
+			// refresh after a backtracked line search or a slow contraction
+			double contraction = grad.norm() / neggrad.norm();
+			isFactorizationReusable = rate >= maxStepSize && contraction < options.lazyHessianContraction;
+		}
 		if (disPlayInfo)
 		{
-			std::cout << "line search rate : " << rate << ", actual hessian : " << !isProj << ", reg = " << reg << std::endl;
+			std::cout << "line search rate : " << rate << ", energy evaluations : " << numEvals << ", actual hessian : " << !isProj << ", reg = " << reg << std::endl;
 			std::cout << "f_old: " << f << ", f_new: " << fnew << ", grad norm: " << grad.norm() << ", delta x: " << rate * delta_x.norm() << ", delta_f: " << f - fnew << std::endl;
 			if (getNormFunc)
 			{
@@ -130,6 +476,8 @@ void OptSolver::newtonSolver(std::function<double(const Eigen::VectorXd&, Eigen:
 				getNormFunc(rate * delta_x, updatez, updatew);
 				std::cout << "z grad: " << gradz << ", w grad: " << gradw << ", z change: " << updatez << ", w change: " << updatew  << std::endl;
 			}
+			if (options.iterationLog)
+				options.iterationLog();
             std::cout << "timing info (in total seconds): " << std::endl;
             std::cout << "assembling took: " << totalAssemblingTime << ", LLT solver took: "  << totalSolvingTime << ", line search took: " << totalLineSearchTime << std::endl;
 		}
@@ -146,7 +494,7 @@ void OptSolver::newtonSolver(std::function<double(const Eigen::VectorXd&, Eigen:
 
 		if (savingFolder)
 		{
-			optInfo << "line search rate : " << rate << ", actual hessian : " << !isProj << ", reg = " << reg << std::endl;
+			optInfo << "line search rate : " << rate << ", energy evaluations : " << numEvals << ", actual hessian : " << !isProj << ", reg = " << reg << std::endl;
 			optInfo << "f_old: " << f << ", f_new: " << fnew << ", grad norm: " << grad.norm() << ", delta x: " << rate * delta_x.norm() << ", delta_f: " << f - fnew << std::endl;
 			if (getNormFunc)
 			{
@@ -203,7 +551,19 @@ void OptSolver::newtonSolver(std::function<double(const Eigen::VectorXd&, Eigen:
     if(disPlayInfo)
     {
         std::cout << "total time costed (s): " << totalTimer.elapsedSeconds() << ", within that, assembling took: " << totalAssemblingTime << ", LLT solver took: "  << totalSolvingTime << ", line search took: " << totalLineSearchTime << std::endl;
+        std::cout << "reusing the symbolic analysis saved (s): " << totalSavedAnalyzeTime << std::endl;
+        std::cout << "factorizations: " << totalFactorizations << std::endl;
+        std::cout << "line search (" << options.lineSearch << ") energy evaluations: " << totalLineSearchEvals << std::endl;
+        if (options.isLazyHessian)
+            std::cout << "iterations reusing the last factorization: " << numReusedFactorizations << " out of " << i << std::endl;
+        if (pcgSolver)
+            std::cout << "total PCG iterations: " << totalInnerIters << std::endl;
     }
+	if (pcgSolver)
+	{
+		pcgSolver->setTolerance(pcgTolerance);
+		pcgSolver->setOperator(nullptr);	// the matrix-free operator refers to this solve
+	}
 	if (saveProcess)
 	{
 		saveProcess(x0, savingFolder);
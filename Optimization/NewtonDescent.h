@@ -4,10 +4,41 @@
 #include <Eigen/Sparse>
 #include <Eigen/Dense>
 #include <Eigen/Core>
+#include <memory>
+#include "LinearSolver.h"
+
+struct NewtonSolverOptions
+{
+	std::shared_ptr<LinearSolver> linearSolver = nullptr;	// CHOLMOD supernodal LLT if not set, with a constraintBasis the solvers laid out for the full DOFs are rebuilt for the reduced size
+	bool isMatrixFreeHessian = false;	// PCG only: hessian-vector products by finite differences of the gradient once the actual (unprojected) hessian is used
+	bool isInexactNewton = false;	// PCG only: adapt the PCG tolerance with Eisenstat-Walker forcing terms
+	bool isLazyHessian = false;	// modified Newton: reuse the last factorization once the actual hessian is used (isProj is off)
+	double lazyHessianContraction = 0.5;	// refactorize when ||g_new|| / ||g_old|| of a step exceeds this
+	std::string lineSearch = "backtracking";	// "backtracking" (halving) or "interpolation" (safeguarded quadratic / cubic interpolation)
+	int lineSearchMaxEvals = 50;	// energy evaluations allowed per line search
+	Eigen::SparseMatrix<double> constraintBasis;	// sparse null-space basis T of linear constraints (see sparseNullspace): Newton runs on x = x0 + T q
+	std::function<void()> iterationLog = nullptr;	// model-specific output, printed with the per-iteration log when displayInfo is on
+};
+
+// Eisenstat-Walker forcing terms (choice 2): eta_k = gamma (||g_k|| / ||g_{k-1}||)^alpha, safeguarded and kept in [etaMin, etaMax]
+struct ForcingTerm
+{
+	double etaMin = 1e-8;
+	double etaMax = 0.9;
+	double gamma = 0.9;
+	double alpha = 2.0;
+
+	// relative tolerance of the next inner solve, given the current residual norm and the outer tolerance
+	double next(double gradNorm, double gradTol);
+
+private:
+	double _eta = -1;
+	double _prevGradNorm = -1;
+};
 
 namespace OptSolver
 {
-	void newtonSolver(std::function<double(const Eigen::VectorXd&, Eigen::VectorXd*, Eigen::SparseMatrix<double>*, bool)> objFunc, Eigen::VectorXd& x0, int numIter = 1000, double gradTol = 1e-14, double xTol = 0, double fTol = 0, bool displayInfo = true, std::function<void(const Eigen::VectorXd&, double&, double&)> getNormFunc = nullptr, std::function<double(const Eigen::VectorXd&, const Eigen::VectorXd&)> findMaxStep = nullptr, std::string *savingFolder = nullptr, std::function<void(const Eigen::VectorXd&, std::string*)> saveProcess = nullptr);
+	void newtonSolver(std::function<double(const Eigen::VectorXd&, Eigen::VectorXd*, Eigen::SparseMatrix<double>*, bool)> objFunc, Eigen::VectorXd& x0, int numIter = 1000, double gradTol = 1e-14, double xTol = 0, double fTol = 0, bool displayInfo = true, std::function<void(const Eigen::VectorXd&, double&, double&)> getNormFunc = nullptr, std::function<double(const Eigen::VectorXd&, const Eigen::VectorXd&)> findMaxStep = nullptr, std::string *savingFolder = nullptr, std::function<void(const Eigen::VectorXd&, std::string*)> saveProcess = nullptr, const NewtonSolverOptions& options = NewtonSolverOptions());
 }
 
 
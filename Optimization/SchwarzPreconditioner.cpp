@@ -0,0 +1,120 @@
+#include <iostream>
+#include <atomic>
+#include <tbb/tbb.h>
+#include "SchwarzPreconditioner.h"
+
+SchwarzPreconditioner::SchwarzPreconditioner(const std::vector<std::vector<int> >& subdomainDOFs, const Eigen::MatrixXd& nearNullspace)
+    : _subdomainDOFs(subdomainDOFs), _nearNullspace(nearNullspace)
+{
+}
+
+void SchwarzPreconditioner::buildCoarseBasis(int dim)
+{
+    std::vector<int> multiplicity(dim, 0);
+    for (const auto& dofs : _subdomainDOFs)
+        for (int d : dofs)
+            multiplicity[d]++;
+
+    // one column per subdomain and near-nullspace vector, the modes vanishing on a subdomain are dropped
+    std::vector<Eigen::Triplet<double> > T;
+    int ncols = 0;
+    for (const auto& dofs : _subdomainDOFs)
+    {
+        for (int m = 0; m < _nearNullspace.cols(); m++)
+        {
+            int start = T.size();
+            for (int d : dofs)
+            {
+                double value = _nearNullspace(d, m) / multiplicity[d];
+                if (value != 0)
+                    T.push_back({ d, ncols, value });
+            }
+            if (T.size() > start)
+                ncols++;
+        }
+    }
+    _coarseBasis.resize(dim, ncols);
+    _coarseBasis.setFromTriplets(T.begin(), T.end());
+}
+
+bool SchwarzPreconditioner::compute(const Eigen::SparseMatrix<double>& A)
+{
+    const int n = A.rows();
+    const int numSub = _subdomainDOFs.size();
+    if (_nearNullspace.rows() == n && _coarseBasis.rows() != n)
+        buildCoarseBasis(n);
+
+    _localSolvers.resize(numSub);
+    std::atomic<bool> isSPD(true);
+    auto factorizeSubdomains = [&](const tbb::blocked_range<int>& range)
+    {
+        std::vector<int> localId(n, -1);
+        for (int s = range.begin(); s != range.end(); s++)
+        {
+            const auto& dofs = _subdomainDOFs[s];
+            for (int i = 0; i < dofs.size(); i++)
+                localId[dofs[i]] = i;
+
+            std::vector<Eigen::Triplet<double> > T;
+            for (int i = 0; i < dofs.size(); i++)
+                for (Eigen::SparseMatrix<double>::InnerIterator it(A, dofs[i]); it; ++it)
+                    if (localId[it.row()] >= 0)
+                        T.push_back({ localId[it.row()], i, it.value() });
+            Eigen::SparseMatrix<double> As(dofs.size(), dofs.size());
+            As.setFromTriplets(T.begin(), T.end());
+
+            if (!_localSolvers[s])
+                _localSolvers[s] = std::make_unique<Eigen::SimplicialLLT<Eigen::SparseMatrix<double> > >();
+            _localSolvers[s]->compute(As);
+            if (_localSolvers[s]->info() != Eigen::Success)
+                isSPD = false;
+
+            for (int d : dofs)
+                localId[d] = -1;
+        }
+    };
+    tbb::parallel_for(tbb::blocked_range<int>(0, numSub), factorizeSubdomains);
+    if (!isSPD)
+        return false;
+
+    if (_coarseBasis.cols() > 0)
+    {
+        Eigen::SparseMatrix<double> AP = A * _coarseBasis;
+        Eigen::MatrixXd A0 = Eigen::MatrixXd(_coarseBasis.transpose() * AP);
+        // the subdomain modes can be nearly dependent on tiny subdomains
+        A0.diagonal().array() += 1e-12 * A0.diagonal().cwiseAbs().maxCoeff();
+        _coarseSolver.compute(A0);
+        if (_coarseSolver.info() != Eigen::Success)
+            return false;
+    }
+    return true;
+}
+
+Eigen::VectorXd SchwarzPreconditioner::apply(const Eigen::VectorXd& r) const
+{
+    const int numSub = _subdomainDOFs.size();
+    std::vector<Eigen::VectorXd> localSols(numSub);
+    auto solveSubdomains = [&](const tbb::blocked_range<int>& range)
+    {
+        for (int s = range.begin(); s != range.end(); s++)
+        {
+            const auto& dofs = _subdomainDOFs[s];
+            Eigen::VectorXd rs(dofs.size());
+            for (int i = 0; i < dofs.size(); i++)
+                rs[i] = r[dofs[i]];
+            localSols[s] = _localSolvers[s]->solve(rs);
+        }
+    };
+    tbb::parallel_for(tbb::blocked_range<int>(0, numSub), solveSubdomains);
+
+    Eigen::VectorXd z = Eigen::VectorXd::Zero(r.size());
+    for (int s = 0; s < numSub; s++)
+    {
+        const auto& dofs = _subdomainDOFs[s];
+        for (int i = 0; i < dofs.size(); i++)
+            z[dofs[i]] += localSols[s][i];
+    }
+    if (_coarseBasis.cols() > 0)
+        z += _coarseBasis * _coarseSolver.solve(Eigen::VectorXd(_coarseBasis.transpose() * r));
+    return z;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+#include "LinearSolver.h"
+
+/*
+ * Two-level overlapping additive Schwarz preconditioner of PCG:
+ *     M^{-1} = sum_i R_i^T A_i^{-1} R_i + Phi (Phi^T A Phi)^{-1} Phi^T,
+ * the subdomain problems A_i = R_i A R_i^T are factorized (and solved) concurrently with TBB, and the coarse space Phi holds
+ * the near-nullspace (the rigid-body modes, see ElasticShellModel::nearNullspace) of every subdomain, glued by the partition
+ * of unity 1 / (number of subdomains sharing a DOF). The subdomains come from a partition of the mesh, see
+ * ThinShellSolver::schwarzSubdomains.
+ */
+class SchwarzPreconditioner : public Preconditioner
+{
+public:
+    SchwarzPreconditioner(const std::vector<std::vector<int> >& subdomainDOFs, const Eigen::MatrixXd& nearNullspace);
+
+    virtual std::string name() const override { return "schwarz"; }
+    virtual bool compute(const Eigen::SparseMatrix<double>& A) override;
+    virtual Eigen::VectorXd apply(const Eigen::VectorXd& r) const override;
+
+    int numSubdomains() const { return _subdomainDOFs.size(); }
+    int coarseSize() const { return _coarseBasis.cols(); }
+
+private:
+    void buildCoarseBasis(int dim);
+
+    std::vector<std::vector<int> > _subdomainDOFs;
+    Eigen::MatrixXd _nearNullspace;
+
+    std::vector<std::unique_ptr<Eigen::SimplicialLLT<Eigen::SparseMatrix<double> > > > _localSolvers;
+    Eigen::SparseMatrix<double> _coarseBasis;	// Phi
+    Eigen::LDLT<Eigen::MatrixXd> _coarseSolver;
+};
@@ -4,6 +4,7 @@
 #include "../SecondFundamentalForm/SecondFundamentalFormDiscretization.h"
 
 #include "../Common/CommonFunctions.h"
+#include "LinearSolver.h"
 
 
 struct FullSimOptimizationParams
@@ -15,12 +16,37 @@ struct FullSimOptimizationParams
 	bool isProjH = true; // whether to use positive definite fix
 	bool isParallel = true; // whether to use parallel computation
 	bool printLog = true; // whether to print log
+	SolverType solverType = Newton; // Newton, Lbfgs or TrustRegion (full simulation only)
 };
 
 // in libThinShells, the density is the volume density now.
 namespace ThinShellSolver
 {
 	void fullSimNewtonStaticSolver(const ElasticSetup& setup, ElasticState& curState, std::string filePrefix, const FullSimOptimizationParams& params);
-	void quasiStaticNewtonSolver(const ElasticSetup& setup, ElasticState& curState, std::string filePrefix, const FullSimOptimizationParams& params);
+	// returns the number of Newton iterations, the loads are scaled by loadFactor. With predictedState, the last tangent factorization
+	// also gives the first order guess of the state at loadFactor + nextLoadIncrement
+	int quasiStaticNewtonSolver(const ElasticSetup& setup, ElasticState& curState, std::string filePrefix, const FullSimOptimizationParams& params, double loadFactor = 1.0, double nextLoadIncrement = 0, ElasticState* predictedState = nullptr);
+	// ramp the loads over setup.numInterp steps of quasiStaticNewtonSolver, each step starting from the setup.loadStepPredictor guess
+	void loadSteppingSolver(const ElasticSetup& setup, ElasticState& curState, std::string filePrefix, const FullSimOptimizationParams& params);
 	void linearPlateBending(const ElasticSetup& setup, ElasticState& curState, std::string filePrefix, const FullSimOptimizationParams& params);
+	// linearization at the initial state (membrane, bending and load stiffness), one factorization for the setup loads or all the load cases
+	void linearStaticSolver(const ElasticSetup& setup, ElasticState& curState, std::string filePrefix, const FullSimOptimizationParams& params);
+	// lowest vibration modes (lumped mass) or linear buckling modes (geometric stiffness of the linear prebuckling state) of the
+	// tangent at the initial state, by shift-invert Lanczos on one factorization
+	void eigenAnalysisSolver(const ElasticSetup& setup, ElasticState& curState, std::string filePrefix, const FullSimOptimizationParams& params);
+	// gradients of the point forces of each load case, projected on the free DOFs
+	Eigen::MatrixXd loadCaseGradients(const ElasticSetup& setup, ElasticShellModel& model, const ElasticState& curState);
+	// write the displacements of the load cases x + du.col(c) to <output mesh>_load_cases.bin
+	void saveLoadCases(const ElasticSetup& setup, ElasticShellModel& model, const Eigen::VectorXd& x, const Eigen::MatrixXd& du, const ElasticState& curState);
+	// ramp the loads from 0 to 1 with Crisfield's (cylindrical) arc length method and an adaptive arc length, passes the limit points
+	void arcLengthContinuationSolver(const ElasticSetup& setup, ElasticState& curState, std::string filePrefix, const FullSimOptimizationParams& params);
+
+	// the linear solver chosen in the setup, fed with the model data it needs (DOF groups, rigid-body modes, subdivision hierarchy)
+	std::shared_ptr<LinearSolver> buildLinearSolver(const ElasticSetup& setup, ElasticShellModel& model, int dim, const std::vector<Eigen::SparseMatrix<double> >& levelOperators = {});
+	// prolongators between the free DOFs of consecutive subdivision levels, coarsest first
+	std::vector<Eigen::SparseMatrix<double> > subdivisionProlongators(const ElasticSetup& setup, ElasticShellModel& model);
+	// constant bending hessians assembled on the coarse subdivision levels, coarsest first
+	std::vector<Eigen::SparseMatrix<double> > levelBendingHessians(const ElasticSetup& setup, const ElasticState& state, std::string filePrefix, const FullSimOptimizationParams& params);
+	// overlapping subdomains of the free DOFs: a partition of the face graph into numParts, grown by overlap layers of faces
+	std::vector<std::vector<int> > schwarzSubdomains(ElasticShellModel& model, int numParts, int overlap);
 };
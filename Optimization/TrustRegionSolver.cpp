@@ -0,0 +1,233 @@
+#include <fstream>
+#include <iomanip>
+#include "TrustRegionSolver.h"
+#include "../Common/Timer.h"
+
+// smallest tau >= 0 with ||p + tau d||_M = radius, from the M inner products pMp, pMd and dMd
+static double boundaryStep(double pMp, double pMd, double dMd, double radius)
+{
+	double disc = pMd * pMd + dMd * (radius * radius - pMp);
+	return (-pMd + std::sqrt(std::max(disc, 0.0))) / dMd;
+}
+
+enum class SteihaugExit { Converged, NegativeCurvature, Boundary, MaxIterations };
+
+// approximately minimize g^T p + 1/2 p^T H p subject to ||p||_M <= radius
+static Eigen::VectorXd steihaugCG(const Eigen::SparseMatrix<double>& H, const Eigen::VectorXd& g, const Preconditioner& precon, double radius, double tol, int maxIter, int& iters, SteihaugExit& exitType, double& pNormM)
+{
+	Eigen::VectorXd p = Eigen::VectorXd::Zero(g.size());
+	Eigen::VectorXd r = g;
+	Eigen::VectorXd z = precon.apply(r);
+	Eigen::VectorXd d = -z;
+	double rz = r.dot(z);
+	double gnorm = g.norm();
+
+	// M inner products are updated by recurrences, M itself is never applied
+	double pMp = 0, pMd = 0, dMd = rz;
+	exitType = SteihaugExit::MaxIterations;
+	pNormM = 0;
+	iters = 0;
+	if (gnorm == 0)
+	{
+		exitType = SteihaugExit::Converged;
+		return p;
+	}
+
+	for (; iters < maxIter; iters++)
+	{
+		Eigen::VectorXd Hd = H * d;
+		double dHd = d.dot(Hd);
+		if (dHd <= 0)
+		{
+			exitType = SteihaugExit::NegativeCurvature;
+			p += boundaryStep(pMp, pMd, dMd, radius) * d;
+			pNormM = radius;
+			return p;
+		}
+
+		double alpha = rz / dHd;
+		double pMpNew = pMp + 2 * alpha * pMd + alpha * alpha * dMd;
+		if (pMpNew >= radius * radius)
+		{
+			exitType = SteihaugExit::Boundary;
+			p += boundaryStep(pMp, pMd, dMd, radius) * d;
+			pNormM = radius;
+			return p;
+		}
+
+		p += alpha * d;
+		r += alpha * Hd;
+		pMp = pMpNew;
+		if (r.norm() <= tol * gnorm)
+		{
+			exitType = SteihaugExit::Converged;
+			iters++;
+			break;
+		}
+
+		z = precon.apply(r);
+		double rzNew = r.dot(z);
+		double beta = rzNew / rz;
+		pMd = beta * (pMd + alpha * dMd);
+		dMd = rzNew + beta * beta * dMd;
+		d = -z + beta * d;
+		rz = rzNew;
+	}
+	pNormM = std::sqrt(pMp);
+	return p;
+}
+
+void OptSolver::trustRegionSolver(std::function<double(const Eigen::VectorXd&, Eigen::VectorXd*, Eigen::SparseMatrix<double>*, bool)> objFunc, Eigen::VectorXd& x0, int numIter, double gradTol, double xTol, double fTol, bool disPlayInfo, std::function<void(const Eigen::VectorXd&, double&, double&)> getNormFunc, std::function<double(const Eigen::VectorXd&, const Eigen::VectorXd&)> findMaxStep, std::string* savingFolder, std::function<void(const Eigen::VectorXd&, std::string*)> saveProcess, const TrustRegionSolverOptions& options)
+{
+	const int DIM = x0.rows();
+	Eigen::VectorXd grad = Eigen::VectorXd::Zero(DIM);
+	Eigen::SparseMatrix<double> hessian;
+	std::shared_ptr<Preconditioner> precon = options.preconditioner ? options.preconditioner : std::make_shared<JacobiPreconditioner>();
+
+	Timer totalTimer;
+	double totalAssemblingTime = 0;
+	double totalSolvingTime = 0;
+	int totalCGIters = 0;
+	totalTimer.start();
+
+	std::ofstream optInfo;
+	if (savingFolder)
+	{
+		optInfo = std::ofstream((*savingFolder) + "optInfo.txt");
+		optInfo << "Trust region solver with termination criterion: " << std::endl;
+		std::cout << "gradient tol: " << gradTol << ", function update tol: " << fTol << ", variable update tol: " << xTol << ", maximum iteration: " << numIter << std::endl << std::endl;
+	}
+
+	Timer localTimer;
+	localTimer.start();
+	double f = objFunc(x0, &grad, &hessian, false);
+	precon->compute(hessian);
+	localTimer.stop();
+	totalAssemblingTime += localTimer.elapsedSeconds();
+
+	double radius = options.initialRadius;
+	if (radius <= 0)
+		radius = std::sqrt(grad.dot(precon->apply(grad)));
+	radius = std::min(std::max(radius, 1e-12), options.maxRadius);
+
+	int i = 0;
+	for (; i < numIter; i++)
+	{
+		if (disPlayInfo)
+			std::cout << "\niter: " << i << std::endl;
+		if (savingFolder)
+			optInfo << "\niter: " << i << std::endl;
+
+		localTimer.start(); // solving time
+		int cgIters = 0;
+		SteihaugExit exitType;
+		double pNormM = 0;
+		double cgTol = options.cgTolerance * std::min(1.0, std::sqrt(grad.norm()));
+		Eigen::VectorXd p = steihaugCG(hessian, grad, *precon, radius, cgTol, options.cgMaxIterations, cgIters, exitType, pNormM);
+		totalCGIters += cgIters;
+		if (findMaxStep)
+		{
+			double maxStep = findMaxStep(x0, p);
+			if (maxStep < 1)
+			{
+				p *= maxStep;
+				pNormM *= maxStep;
+			}
+		}
+		double predicted = -(grad.dot(p) + 0.5 * p.dot(hessian * p));
+		localTimer.stop();
+		totalSolvingTime += localTimer.elapsedSeconds();
+
+		Eigen::VectorXd xnew = x0 + p;
+		double fnew = objFunc(xnew, NULL, NULL, false);
+		double rho = predicted > 0 ? (f - fnew) / predicted : -1;
+
+		// radius update
+		double oldRadius = radius;
+		if (rho < 0.25)
+			radius = 0.25 * pNormM;
+		else if (rho > 0.75 && exitType != SteihaugExit::Converged)
+			radius = std::min(2 * radius, options.maxRadius);
+
+		bool isAccepted = rho > options.acceptRatio;
+		double fold = f;
+		if (isAccepted)
+		{
+			x0 = xnew;
+			localTimer.start();
+			f = objFunc(x0, &grad, &hessian, false);
+			// the radius is measured in the M-norm, carry it over to the new M by the ratio of the dual norms of the new
+			// gradient, sqrt(g^T M_old^{-1} g / g^T M_new^{-1} g) (exact when M only changes by a scale)
+			double oldDualNorm = grad.dot(precon->apply(grad));
+			precon->compute(hessian);
+			double newDualNorm = grad.dot(precon->apply(grad));
+			if (oldDualNorm > 0 && newDualNorm > 0)
+				radius = std::min(radius * std::sqrt(oldDualNorm / newDualNorm), options.maxRadius);
+			localTimer.stop();
+			totalAssemblingTime += localTimer.elapsedSeconds();
+		}
+
+		const char* exitNames[] = { "converged", "negative curvature", "boundary", "max iterations" };
+		if (disPlayInfo)
+		{
+			std::cout << "CG iterations: " << cgIters << " (total: " << totalCGIters << "), exit: " << exitNames[int(exitType)] << ", rho: " << rho << ", radius: " << oldRadius << " -> " << radius << (isAccepted ? "" : ", step rejected") << std::endl;
+			std::cout << "f_old: " << fold << ", f_new: " << f << ", grad norm: " << grad.norm() << ", delta x: " << (isAccepted ? p.norm() : 0) << ", delta_f: " << fold - f << std::endl;
+			if (getNormFunc)
+			{
+				double gradz, gradw;
+				getNormFunc(grad, gradz, gradw);
+
+				double updatez, updatew;
+				getNormFunc(p, updatez, updatew);
+				std::cout << "z grad: " << gradz << ", w grad: " << gradw << ", z change: " << updatez << ", w change: " << updatew << std::endl;
+			}
+			if (options.iterationLog)
+				options.iterationLog();
+			std::cout << "timing info (in total seconds): " << std::endl;
+			std::cout << "assembling took: " << totalAssemblingTime << ", truncated CG took: " << totalSolvingTime << std::endl;
+		}
+		if (savingFolder)
+		{
+			optInfo << "CG iterations: " << cgIters << ", exit: " << exitNames[int(exitType)] << ", rho: " << rho << ", radius: " << oldRadius << " -> " << radius << (isAccepted ? "" : ", step rejected") << std::endl;
+			optInfo << "f_old: " << fold << ", f_new: " << f << ", grad norm: " << grad.norm() << ", delta x: " << (isAccepted ? p.norm() : 0) << ", delta_f: " << fold - f << std::endl;
+		}
+		if (saveProcess && i % 50 == 0)
+			saveProcess(x0, savingFolder);
+
+		// termination criteria
+		if (grad.norm() < gradTol)
+		{
+			std::cout << "terminate with gradient L2-norm = " << grad.norm() << std::endl;
+			break;
+		}
+		if (radius < 1e-14)
+		{
+			std::cout << "terminate with small trust region radius (<1e-14): L2-norm = " << grad.norm() << std::endl;
+			break;
+		}
+		if (!isAccepted)
+			continue;
+		if (p.norm() < xTol)
+		{
+			std::cout << "terminate with small variable change, gradient L2-norm = " << grad.norm() << std::endl;
+			break;
+		}
+		if (fold - f < fTol)
+		{
+			std::cout << "terminate with small energy change, gradient L2-norm = " << grad.norm() << std::endl;
+			break;
+		}
+	}
+
+	if (i >= numIter && disPlayInfo)
+		std::cout << "terminate with reaching the maximum iteration, with gradient L2-norm = " << grad.norm() << std::endl;
+
+	totalTimer.stop();
+	if (disPlayInfo)
+	{
+		std::cout << "end up with energy: " << f << ", gradient: " << grad.norm() << std::endl;
+		std::cout << "total time costed (s): " << totalTimer.elapsedSeconds() << ", within that, assembling took: " << totalAssemblingTime << ", truncated CG took: " << totalSolvingTime << ", total CG iterations: " << totalCGIters << std::endl;
+	}
+	if (saveProcess)
+		saveProcess(x0, savingFolder);
+}
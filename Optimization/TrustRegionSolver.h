@@ -0,0 +1,29 @@
+#pragma once
+
+#include <iostream>
+#include <memory>
+#include <Eigen/Sparse>
+#include <Eigen/Dense>
+#include <Eigen/Core>
+#include "LinearSolver.h"
+
+struct TrustRegionSolverOptions
+{
+	std::shared_ptr<Preconditioner> preconditioner = nullptr;	// must be SPD, defines the trust region norm ||p||_M (rebuilt after each accepted step, the radius is rescaled), jacobi if not set
+	double initialRadius = 0;	// <= 0: the M-norm of the preconditioned gradient
+	double maxRadius = 1e10;
+	double acceptRatio = 1e-4;	// accept the step if actual / predicted reduction is above this
+	double cgTolerance = 0.1;	// relative residual of the truncated CG, scaled by min(1, sqrt(||g||))
+	int cgMaxIterations = 1000;
+	std::function<void()> iterationLog = nullptr;	// model-specific output, printed with the per-iteration log when displayInfo is on
+};
+
+namespace OptSolver
+{
+	/*
+	 * Trust-region Newton with the Steihaug-Toint truncated CG subproblem, on the actual (not projected) hessian. Negative
+	 * curvature directions are followed to the trust region boundary, so indefinite hessians never need a regularization
+	 * or a refactorization.
+	 */
+	void trustRegionSolver(std::function<double(const Eigen::VectorXd&, Eigen::VectorXd*, Eigen::SparseMatrix<double>*, bool)> objFunc, Eigen::VectorXd& x0, int numIter = 1000, double gradTol = 1e-14, double xTol = 0, double fTol = 0, bool displayInfo = true, std::function<void(const Eigen::VectorXd&, double&, double&)> getNormFunc = nullptr, std::function<double(const Eigen::VectorXd&, const Eigen::VectorXd&)> findMaxStep = nullptr, std::string *savingFolder = nullptr, std::function<void(const Eigen::VectorXd&, std::string*)> saveProcess = nullptr, const TrustRegionSolverOptions& options = TrustRegionSolverOptions());
+}
@@ -0,0 +1,188 @@
+#include <igl/writeOBJ.h>
+#include "ThinShellSolver.h"
+#include "../Common/Timer.h"
+#include "LinearSolver.h"
+
+void ThinShellSolver::arcLengthContinuationSolver(const ElasticSetup& setup, ElasticState& curState, std::string filePrefix, const FullSimOptimizationParams& params)
+{
+    const double relTol = 1e-3;
+    const int targetCorrections = 4;    // the arc length is adapted towards this number of corrections per increment
+    const int maxCorrections = 15;
+    const double minArcLengthRatio = 1e-6;
+
+    ElasticShellModel model;
+    bool ok = model.initialization(setup, curState, filePrefix, params.isProjH, params.isParallel);
+    if (!ok)
+    {
+        std::cout << "initialization failed." << std::endl;
+        return;
+    }
+    Eigen::VectorXd x;
+    model.convertCurState2Variables(curState, x);
+
+    Eigen::SparseMatrix<double> bendingHess;
+    if (setup.bendingType != "midEdgeShell")
+        bendingHess = model.bendingHessian(x);
+
+    // residual R(x, lambda) of the equilibrium under the loads scaled by lambda, and its tangent stiffness
+    auto residual = [&](const Eigen::VectorXd& y, double lambda)
+    {
+        model._loadFactor = lambda;
+        Eigen::VectorXd grad;
+        if (setup.bendingType == "midEdgeShell")
+            model.gradient(y, grad);
+        else
+            grad = model.membraneGrad(y) + model.bendingGrad(y) + model.externalForces(y);
+        return grad;
+    };
+    auto tangent = [&](const Eigen::VectorXd& y, double lambda)
+    {
+        model._loadFactor = lambda;
+        Eigen::SparseMatrix<double> hess;
+        if (setup.bendingType == "midEdgeShell")
+            model.hessian(y, hess);
+        else
+            hess = model.membraneHessian(y) + bendingHess + model.exterHessian(y);
+        hess.makeCompressed();
+        return hess;
+    };
+    // R is linear in lambda, so dR/dlambda is exact from two evaluations (and leaves out the unscaled contact forces)
+    auto loadDerivative = [&](const Eigen::VectorXd& y)
+    {
+        return Eigen::VectorXd(residual(y, 1.0) - residual(y, 0.0));
+    };
+
+    // the tangent is indefinite past the limit points, switch to LDLT there. CG only meets the indefiniteness while solving, so
+    // the right hand sides of one tangent are solved together and a solve stopped on negative curvature also switches
+    std::shared_ptr<LinearSolver> solver = buildLinearSolver(setup, model, x.size());
+    std::shared_ptr<LinearSolver> ldltSolver;
+    int numFactorizations = 0;
+    auto solveTangent = [&](const Eigen::SparseMatrix<double>& K, const Eigen::MatrixXd& rhs)
+    {
+        numFactorizations++;
+        Eigen::MatrixXd sol(rhs.rows(), rhs.cols());
+        solver->analyzePatternIfChanged(K);
+        if (solver->factorize(K))
+        {
+            bool isIndefinite = false;
+            for (int j = 0; j < rhs.cols() && !isIndefinite; j++)
+            {
+                sol.col(j) = solver->solve(Eigen::VectorXd(rhs.col(j)));
+                isIndefinite = solver->isIndefiniteDetected();
+            }
+            if (!isIndefinite)
+                return sol;
+        }
+        if (!ldltSolver)
+            ldltSolver = createLinearSolver("eigen_ldlt", K.rows());
+        ldltSolver->analyzePatternIfChanged(K);
+        ldltSolver->factorize(K);
+        return ldltSolver->solve(rhs);
+    };
+
+    double lambda = 0;
+    double arcLength = -1;
+    double initialArcLength = -1;
+    Eigen::VectorXd prevDx;
+    int totalCorrections = 0;
+    int numIncrements = 0;
+    int numCuts = 0;
+
+    Timer timer;
+    timer.start();
+    while (std::abs(1 - lambda) > 1e-10 && totalCorrections < params.iterations)
+    {
+        // predictor along the tangent du/dlambda, keeping the direction of the last increment through the limit points
+        Eigen::VectorXd q = loadDerivative(x);
+        Eigen::VectorXd ut = solveTangent(tangent(x, lambda), -q);
+        if (arcLength < 0)
+        {
+            arcLength = ut.norm() / std::max(1, setup.numInterp);
+            initialArcLength = arcLength;
+        }
+        double dLambda = arcLength / ut.norm();
+        if (prevDx.size() && prevDx.dot(ut) < 0)
+            dLambda = -dLambda;
+
+        // the increment reaching the full load is load controlled, so that it ends exactly at lambda = 1
+        bool isLoadControlled = (lambda + dLambda >= 1) || (lambda > 1);
+        if (isLoadControlled)
+            dLambda = 1 - lambda;
+        Eigen::VectorXd Dx = dLambda * ut;
+        double Dlambda = dLambda;
+
+        // corrector: Newton on R = 0 and the cylindrical arc length constraint ||Dx|| = arcLength
+        bool isConverged = false;
+        int k = 0;
+        for (; k < maxCorrections; k++)
+        {
+            Eigen::VectorXd R = residual(x + Dx, lambda + Dlambda);
+            double forceNorm = std::abs(lambda + Dlambda) * q.norm();
+            if (R.norm() <= relTol * forceNorm)
+            {
+                isConverged = true;
+                break;
+            }
+            if (!std::isfinite(R.norm()))
+                break;
+
+            // uR and uT = du/dlambda on the same tangent, only uR when the load is controlled
+            Eigen::MatrixXd rhs(R.size(), isLoadControlled ? 1 : 2);
+            rhs.col(0) = -R;
+            if (!isLoadControlled)
+                rhs.col(1) = -loadDerivative(x + Dx);
+            Eigen::MatrixXd sol = solveTangent(tangent(x + Dx, lambda + Dlambda), rhs);
+            Eigen::VectorXd uR = sol.col(0);
+            totalCorrections++;
+            if (isLoadControlled)
+            {
+                Dx += uR;
+                continue;
+            }
+            Eigen::VectorXd uT = sol.col(1);
+
+            // ||Dx + uR + dl uT||^2 = arcLength^2, pick the root that keeps going forward
+            Eigen::VectorXd w = Dx + uR;
+            double a = uT.squaredNorm();
+            double b = 2 * uT.dot(w);
+            double c = w.squaredNorm() - arcLength * arcLength;
+            double disc = b * b - 4 * a * c;
+            if (disc < 0 || a == 0)
+                break;
+            double dl1 = (-b + std::sqrt(disc)) / (2 * a);
+            double dl2 = (-b - std::sqrt(disc)) / (2 * a);
+            double dl = (w + dl1 * uT).dot(Dx) >= (w + dl2 * uT).dot(Dx) ? dl1 : dl2;
+            Dx = w + dl * uT;
+            Dlambda += dl;
+        }
+
+        if (!isConverged)
+        {
+            numCuts++;
+            arcLength *= 0.5;
+            std::cout << "increment failed after " << k << " corrections, cut the arc length to " << arcLength << std::endl;
+            if (arcLength < minArcLengthRatio * initialArcLength)
+            {
+                std::cout << "arc length is too small, stop at load factor " << lambda << std::endl;
+                break;
+            }
+            continue;
+        }
+
+        x += Dx;
+        lambda += Dlambda;
+        prevDx = Dx;
+        numIncrements++;
+        std::cout << "increment " << numIncrements << ": load factor " << lambda << ", corrections: " << k << ", arc length: " << arcLength << (isLoadControlled ? " (load controlled)" : "") << std::endl;
+
+        // grow the step after fast convergence, shrink it after slow convergence
+        arcLength *= std::min(2.0, std::max(0.5, std::sqrt(double(targetCorrections) / std::max(k, 1))));
+    }
+    timer.stop();
+
+    std::cout << "arc length continuation: " << numIncrements << " increments, " << numCuts << " cuts, " << totalCorrections << " corrections, " << numFactorizations << " factorizations, took " << timer.elapsedSeconds() << " seconds, final load factor: " << lambda << std::endl;
+
+    model._loadFactor = 1.0;
+    model.convertVariables2CurState(x, curState);
+    igl::writeOBJ(setup.outMeshPath, curState.curPos, curState.mesh.faces());
+}
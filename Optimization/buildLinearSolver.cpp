@@ -0,0 +1,222 @@
+#include "ThinShellSolver.h"
+#include "GeometricMultigrid.h"
+#include "SchwarzPreconditioner.h"
+#include "GraphPartition.h"
+#include <thread>
+
+std::vector<Eigen::SparseMatrix<double> > ThinShellSolver::subdivisionProlongators(const ElasticSetup& setup, ElasticShellModel& model)
+{
+    std::vector<Eigen::SparseMatrix<double> > prolongators;
+    int nlevels = setup.subdivisionProlongators.size();
+    if (nlevels == 0)
+        return prolongators;
+
+    // free DOF index of every vertex DOF on a level, the coarse vertices keep their indices on the finer levels
+    auto freeDOFIds = [&](int nverts)
+    {
+        std::vector<int> ids(3 * nverts, -1);
+        int idx = 0;
+        for (int i = 0; i < 3 * nverts; i++)
+        {
+            if (setup.clampedDOFs.find(i) == setup.clampedDOFs.end())
+                ids[i] = idx++;
+        }
+        return std::make_pair(ids, idx);
+    };
+
+    int finestDOFs = model._proj.projDOFs();
+    for (int l = 0; l < nlevels; l++)
+    {
+        const Eigen::SparseMatrix<double>& S = setup.subdivisionProlongators[l];
+        auto coarse = freeDOFIds(S.cols());
+        auto fine = freeDOFIds(S.rows());
+
+        std::vector<Eigen::Triplet<double> > T;
+        for (int k = 0; k < S.outerSize(); k++)
+            for (Eigen::SparseMatrix<double>::InnerIterator it(S, k); it; ++it)
+                for (int j = 0; j < 3; j++)
+                {
+                    int row = fine.first[3 * it.row() + j];
+                    int col = coarse.first[3 * it.col() + j];
+                    if (row != -1 && col != -1)
+                        T.push_back({ row, col, it.value() });
+                }
+
+        // the edge DOFs only live on the finest level, and get no coarse correction
+        int nrows = (l == nlevels - 1) ? finestDOFs : fine.second;
+        Eigen::SparseMatrix<double> P(nrows, coarse.second);
+        P.setFromTriplets(T.begin(), T.end());
+        prolongators.push_back(P);
+    }
+    return prolongators;
+}
+
+std::vector<std::vector<int> > ThinShellSolver::schwarzSubdomains(ElasticShellModel& model, int numParts, int overlap)
+{
+    const MeshConnectivity& mesh = model._state.mesh;
+    int nverts = model._state.curPos.rows();
+    int nfaces = mesh.nFaces();
+    int nedgedofs = model._setup.sff->numExtraDOFs();
+    numParts = std::max(1, std::min(numParts, nfaces));
+
+    // dual graph: faces sharing an edge
+    PartitionGraph graph;
+    graph.xadj.push_back(0);
+    for (int f = 0; f < nfaces; f++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            int e = mesh.faceEdge(f, j);
+            int g = mesh.edgeFace(e, 0) == f ? mesh.edgeFace(e, 1) : mesh.edgeFace(e, 0);
+            if (g >= 0)
+                graph.adjncy.push_back(g);
+        }
+        graph.xadj.push_back(graph.adjncy.size());
+    }
+    std::vector<int> faceParts = partitionGraph(graph, numParts);
+    std::cout << "schwarz: " << numParts << " subdomains, edge cut " << edgeCut(graph, faceParts) << " of " << graph.adjncy.size() / 2 << " face pairs" << std::endl;
+
+    std::vector<std::vector<int> > vertexFaces(nverts);
+    for (int f = 0; f < nfaces; f++)
+        for (int j = 0; j < 3; j++)
+            vertexFaces[mesh.faceVertex(f, j)].push_back(f);
+
+    std::vector<int> fullToFree(model._proj.projDOFs() ? model._proj.fullDOF(model._proj.projDOFs() - 1) + 1 : 0, -1);
+    for (int i = 0; i < model._proj.projDOFs(); i++)
+        fullToFree[model._proj.fullDOF(i)] = i;
+    auto freeDOF = [&](int fullId) { return fullId < fullToFree.size() ? fullToFree[fullId] : -1; };
+
+    std::vector<std::vector<int> > subdomains(numParts);
+    std::vector<int> faceMark(nfaces, -1), dofMark(model._proj.projDOFs(), -1);
+    for (int p = 0; p < numParts; p++)
+    {
+        std::vector<int> faces;
+        for (int f = 0; f < nfaces; f++)
+            if (faceParts[f] == p)
+            {
+                faces.push_back(f);
+                faceMark[f] = p;
+            }
+        // each overlap layer adds the faces sharing a vertex with the subdomain
+        for (int layer = 0; layer < overlap; layer++)
+        {
+            int nfacesBefore = faces.size();
+            for (int k = 0; k < nfacesBefore; k++)
+                for (int j = 0; j < 3; j++)
+                    for (int g : vertexFaces[mesh.faceVertex(faces[k], j)])
+                        if (faceMark[g] != p)
+                        {
+                            faceMark[g] = p;
+                            faces.push_back(g);
+                        }
+        }
+
+        auto addDOF = [&](int fullId)
+        {
+            int d = freeDOF(fullId);
+            if (d >= 0 && dofMark[d] != p)
+            {
+                dofMark[d] = p;
+                subdomains[p].push_back(d);
+            }
+        };
+        for (int f : faces)
+            for (int j = 0; j < 3; j++)
+            {
+                for (int c = 0; c < 3; c++)
+                    addDOF(3 * mesh.faceVertex(f, j) + c);
+                for (int c = 0; c < nedgedofs; c++)
+                    addDOF(3 * nverts + nedgedofs * mesh.faceEdge(f, j) + c);
+            }
+        std::sort(subdomains[p].begin(), subdomains[p].end());
+    }
+    return subdomains;
+}
+
+std::vector<Eigen::SparseMatrix<double> > ThinShellSolver::levelBendingHessians(const ElasticSetup& setup, const ElasticState& state, std::string filePrefix, const FullSimOptimizationParams& params)
+{
+    std::vector<Eigen::SparseMatrix<double> > hessians;
+    for (int l = 0; l < setup.subdivisionProlongators.size(); l++)
+    {
+        int nverts = setup.subdivisionProlongators[l].cols();
+
+        ElasticSetup levelSetup = setup;
+        levelSetup.subdivisionLevels = 0;
+        levelSetup.subdivisionProlongators.clear();
+        levelSetup.subdivisionFaces.clear();
+        levelSetup.restV = setup.restV.topRows(nverts);
+        levelSetup.restF = setup.subdivisionFaces[l];
+        levelSetup.clampedDOFs.clear();
+        for (auto& it : setup.clampedDOFs)
+            if (it.first < 3 * nverts)
+                levelSetup.clampedDOFs.insert(it);
+        levelSetup.pointForces.clear();
+        levelSetup.buildRestFundamentalForms();
+        levelSetup.computeVertArea(nverts, levelSetup.restF);
+
+        ElasticState levelState;
+        levelState.mesh = MeshConnectivity(levelSetup.restF);
+        levelState.initialGuess = state.initialGuess.topRows(nverts);
+        levelState.curPos = levelState.initialGuess;
+        levelSetup.sff->initializeExtraDOFs(levelState.initialEdgeDOFs, levelState.mesh, levelState.initialGuess);
+        levelState.curEdgeDOFs = levelState.initialEdgeDOFs;
+
+        ElasticShellModel levelModel;
+        if (!levelModel.initialization(levelSetup, levelState, filePrefix, params.isProjH, params.isParallel))
+            return {};
+        Eigen::VectorXd x;
+        levelModel.convertCurState2Variables(levelState, x);
+        hessians.push_back(levelModel.bendingHessian(x));
+    }
+    return hessians;
+}
+
+std::shared_ptr<LinearSolver> ThinShellSolver::buildLinearSolver(const ElasticSetup& setup, ElasticShellModel& model, int dim, const std::vector<Eigen::SparseMatrix<double> >& levelOperators)
+{
+    if (dim != model._proj.projDOFs())
+    {
+        // a reduced (constrained) system has no mesh layout left, only the algebraic solvers and preconditioners apply
+        std::string type = setup.linearSolverType == "gmg" ? "auto" : setup.linearSolverType == "schur" ? setup.schurSolverType : setup.linearSolverType;
+        std::string preconditioner = setup.pcgPreconditioner == "ic" ? "ic" : "jacobi";
+        if (type != setup.linearSolverType || (type == "pcg" && preconditioner != setup.pcgPreconditioner))
+            std::cout << "the reduced system of " << dim << " DOFs uses " << type << (type == "pcg" ? " with " + preconditioner : "") << " instead." << std::endl;
+        return createLinearSolver(type, dim, setup.pcgTolerance, setup.pcgMaxIterations, preconditioner);
+    }
+    if (setup.linearSolverType == "gmg" || (setup.linearSolverType == "pcg" && setup.pcgPreconditioner == "gmg"))
+    {
+        auto gmg = std::make_shared<GeometricMultigrid>(subdivisionProlongators(setup, model), levelOperators);
+        std::shared_ptr<LinearSolver> solver;
+        if (setup.linearSolverType == "gmg")
+            solver = std::make_shared<PreconditionedIterationSolver>(gmg, setup.pcgTolerance, setup.pcgMaxIterations);
+        else
+            solver = std::make_shared<PCGLinearSolver>(setup.pcgTolerance, setup.pcgMaxIterations, gmg);
+        std::cout << "linear solver: " << solver->name() << " (" << dim << " DOFs)" << std::endl;
+        return solver;
+    }
+    if (setup.linearSolverType == "schur")
+    {
+        // the free vertex DOFs come first in the Projection layout, the edge DOFs are eliminated
+        int nverts = model._state.curPos.rows();
+        int numVertexDOFs = 0;
+        for (int i = 0; i < model._proj.projDOFs(); i++)
+            if (model._proj.fullDOF(i) < 3 * nverts)
+                numVertexDOFs++;
+        // the vertex system keeps the vertex groups and rigid-body modes for the block preconditioners
+        std::vector<int> dofNodes = model.dofNodeMap();
+        dofNodes.resize(numVertexDOFs);
+        Eigen::MatrixXd nearNullspace = model.nearNullspace().topRows(numVertexDOFs);
+        std::shared_ptr<LinearSolver> vertexSolver = createLinearSolver(setup.schurSolverType, numVertexDOFs, setup.pcgTolerance, setup.pcgMaxIterations, setup.pcgPreconditioner, dofNodes, nearNullspace);
+        std::shared_ptr<LinearSolver> solver = std::make_shared<SchurComplementLinearSolver>(numVertexDOFs, setup.pcgTolerance, setup.pcgMaxIterations, vertexSolver);
+        std::cout << "linear solver: schur (" << numVertexDOFs << " vertex DOFs, " << dim - numVertexDOFs << " eliminated edge DOFs)" << std::endl;
+        return solver;
+    }
+    if (setup.linearSolverType == "pcg" && setup.pcgPreconditioner == "schwarz")
+    {
+        int numParts = setup.schwarzSubdomains > 0 ? setup.schwarzSubdomains : std::max(2, int(std::thread::hardware_concurrency()));
+        auto schwarz = std::make_shared<SchwarzPreconditioner>(schwarzSubdomains(model, numParts, setup.schwarzOverlap), model.nearNullspace());
+        std::shared_ptr<LinearSolver> solver = std::make_shared<PCGLinearSolver>(setup.pcgTolerance, setup.pcgMaxIterations, schwarz);
+        std::cout << "linear solver: " << solver->name() << " (" << dim << " DOFs)" << std::endl;
+        return solver;
+    }
+    return createLinearSolver(setup.linearSolverType, dim, setup.pcgTolerance, setup.pcgMaxIterations, setup.pcgPreconditioner, model.dofNodeMap(), model.nearNullspace());
+}
@@ -0,0 +1,235 @@
+#include <fstream>
+#include <regex>
+#include <igl/writeOBJ.h>
+#include <igl/PI.h>
+#include "ThinShellSolver.h"
+#include "../Common/Timer.h"
+#include "LinearSolver.h"
+
+/*
+ * Shift-invert Lanczos for the largest |nu| of (A - sigma B)^{-1} B phi = nu phi, i.e. the eigenvalues mu = sigma + 1 / nu of
+ * A phi = mu B phi closest to sigma. C = A - sigma B must be SPD: the iteration is self-adjoint in the C inner product, B may be
+ * singular (the massless edge DOFs) or indefinite (the geometric stiffness). The factorization of C is done once by the caller,
+ * with full reorthogonalization of the Krylov basis, which stays small.
+ */
+static bool shiftInvertLanczos(LinearSolver& CSolver, const Eigen::SparseMatrix<double>& C, const Eigen::SparseMatrix<double>& B, int numEigs, int maxDim, double tol, Eigen::VectorXd& nus, Eigen::MatrixXd& vecs, int& numSteps)
+{
+    const int n = C.rows();
+    maxDim = std::min(maxDim, n);
+    Eigen::MatrixXd Q(n, maxDim);
+    std::vector<double> alphas, betas;
+
+    Eigen::VectorXd q = Eigen::VectorXd::Random(n);
+    q /= std::sqrt(q.dot(C * q));
+    Eigen::VectorXd qPrev = Eigen::VectorXd::Zero(n);
+    double beta = 0;
+    bool isConverged = false;
+    numSteps = 0;
+
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> es;
+    for (int j = 0; j < maxDim; j++)
+    {
+        Q.col(j) = q;
+        Eigen::VectorXd Bq = B * q;
+        Eigen::VectorXd w = CSolver.solve(Bq);
+        double alpha = q.dot(Bq);  // = q^T C w
+        w -= alpha * q + beta * qPrev;
+        // full reorthogonalization in the C inner product, twice is enough
+        for (int pass = 0; pass < 2; pass++)
+            w -= Q.leftCols(j + 1) * (Q.leftCols(j + 1).transpose() * (C * w));
+        alphas.push_back(alpha);
+        beta = std::sqrt(std::max(0.0, w.dot(C * w)));
+        numSteps = j + 1;
+
+        // Ritz values of the tridiagonal projection, converged once the residual bound |beta s_j| is small
+        if (numSteps >= numEigs && (numSteps % 5 == 0 || numSteps == maxDim || beta < 1e-14))
+        {
+            Eigen::MatrixXd T = Eigen::MatrixXd::Zero(numSteps, numSteps);
+            for (int i = 0; i < numSteps; i++)
+            {
+                T(i, i) = alphas[i];
+                if (i + 1 < numSteps)
+                    T(i, i + 1) = T(i + 1, i) = betas[i];
+            }
+            es.compute(T);
+            std::vector<int> order(numSteps);
+            for (int i = 0; i < numSteps; i++)
+                order[i] = i;
+            std::sort(order.begin(), order.end(), [&](int a, int b) { return std::abs(es.eigenvalues()[a]) > std::abs(es.eigenvalues()[b]); });
+
+            int numConverged = 0;
+            for (int i = 0; i < numEigs; i++)
+            {
+                double nu = es.eigenvalues()[order[i]];
+                if (std::abs(beta * es.eigenvectors()(numSteps - 1, order[i])) <= tol * std::abs(nu))
+                    numConverged++;
+            }
+            if (numConverged == numEigs || numSteps == maxDim || beta < 1e-14)
+            {
+                isConverged = (numConverged == numEigs);
+                nus.resize(numEigs);
+                vecs.resize(n, numEigs);
+                for (int i = 0; i < numEigs; i++)
+                {
+                    nus[i] = es.eigenvalues()[order[i]];
+                    vecs.col(i) = Q.leftCols(numSteps) * es.eigenvectors().col(order[i]);
+                }
+                return isConverged;
+            }
+        }
+        if (beta < 1e-14)
+            break;
+        betas.push_back(beta);
+        qPrev = q;
+        q = w / beta;
+    }
+    return isConverged;
+}
+
+void ThinShellSolver::eigenAnalysisSolver(const ElasticSetup& setup, ElasticState& curState, std::string filePrefix, const FullSimOptimizationParams& params)
+{
+    const bool isBuckling = setup.eigenAnalysis == "buckling";
+    if (!isBuckling && setup.eigenAnalysis != "modal")
+    {
+        std::cout << "unknown eigen analysis " << setup.eigenAnalysis << ", use modal or buckling." << std::endl;
+        return;
+    }
+
+    // the actual tangent, the positive definite projection would clip the geometric stiffness
+    ElasticShellModel model;
+    bool ok = model.initialization(setup, curState, filePrefix, false, params.isParallel);
+    if (!ok)
+    {
+        std::cout << "initialization failed." << std::endl;
+        return;
+    }
+    Eigen::VectorXd x0;
+    model.convertCurState2Variables(curState, x0);
+    const int dim = x0.size();
+    const int nverts = curState.curPos.rows();
+    const int numEigs = std::min(std::max(1, setup.numEigenpairs), dim);
+
+    auto tangent = [&](const Eigen::VectorXd& x)
+    {
+        Eigen::SparseMatrix<double> K;
+        if (setup.bendingType == "midEdgeShell")
+            model.hessian(x, K);
+        else
+            K = model.membraneHessian(x) + model.bendingHessian(x) + model.exterHessian(x);
+        K.makeCompressed();
+        return K;
+    };
+
+    Timer timer;
+    timer.start();
+    Eigen::SparseMatrix<double> K = tangent(x0);
+    std::shared_ptr<LinearSolver> solver = buildLinearSolver(setup, model, dim);
+
+    // the second matrix of the pencil: the lumped mass, or minus the geometric stiffness of the linear prebuckling state
+    Eigen::SparseMatrix<double> B(dim, dim);
+    if (isBuckling)
+    {
+        solver->analyzePatternIfChanged(K);
+        if (!solver->factorize(K))
+        {
+            std::cout << "the rest tangent is not positive definite, linear buckling needs a supported structure." << std::endl;
+            return;
+        }
+        Eigen::VectorXd grad;
+        if (setup.bendingType == "midEdgeShell")
+            model.gradient(x0, grad);
+        else
+            grad = model.membraneGrad(x0) + model.bendingGrad(x0) + model.externalForces(x0);
+        Eigen::VectorXd u = solver->solve(Eigen::VectorXd(-grad));
+        if (u.norm() == 0)
+        {
+            std::cout << "no load, nothing to buckle." << std::endl;
+            return;
+        }
+        // dK/dlambda along the linear path x0 + lambda u by central differences, exact for the quadratic StVK tangent
+        double eps = 1e-3 * std::max(1.0, x0.cwiseAbs().maxCoeff()) / u.cwiseAbs().maxCoeff();
+        Eigen::SparseMatrix<double> KG = (tangent(x0 + eps * u) - tangent(x0 - eps * u)) / (2 * eps);
+        B = -KG;
+    }
+    else
+    {
+        std::vector<Eigen::Triplet<double> > T;
+        for (int i = 0; i < dim; i++)
+        {
+            int fullId = model._proj.fullDOF(i);
+            if (fullId < 3 * nverts)
+                T.push_back({ i, i, setup.vertArea[fullId / 3] * setup.thickness * setup.density });
+        }
+        B.setFromTriplets(T.begin(), T.end());
+    }
+
+    // C = K - sigma B, a free (unclamped) shell needs a negative shift for the modal analysis
+    double sigma = setup.eigenShift;
+    Eigen::SparseMatrix<double> C = K - sigma * B;
+    C.makeCompressed();
+    bool isFactorized = isBuckling && sigma == 0;   // then C = K is factorized already
+    if (!isFactorized)
+    {
+        solver->analyzePatternIfChanged(C);
+        isFactorized = solver->factorize(C);
+    }
+    if (!isFactorized && !isBuckling && sigma == 0)
+    {
+        sigma = -1e-6 * K.diagonal().cwiseAbs().mean() / std::max(1e-300, B.diagonal().mean());
+        std::cout << "the tangent is singular (rigid motions), shift by " << sigma << std::endl;
+        C = K - sigma * B;
+        C.makeCompressed();
+        solver->analyzePatternIfChanged(C);
+        isFactorized = solver->factorize(C);
+    }
+    if (!isFactorized)
+    {
+        std::cout << solver->name() << " failed to factorize K - sigma B, choose an eigen_shift below the smallest eigenvalue." << std::endl;
+        return;
+    }
+    timer.stop();
+    double setupTime = timer.elapsedSeconds();
+
+    timer.start();
+    Eigen::VectorXd nus;
+    Eigen::MatrixXd modes;
+    int numSteps = 0;
+    bool isConverged = shiftInvertLanczos(*solver, C, B, numEigs, std::max(4 * numEigs, 40) + 100, 1e-8, nus, modes, numSteps);
+    timer.stop();
+    std::cout << "shift-invert Lanczos (" << solver->name() << "): " << numSteps << " steps, " << (isConverged ? "converged" : "not converged") << ", setup took " << setupTime << ", Lanczos took " << timer.elapsedSeconds() << " seconds" << std::endl;
+
+    // eigenvalues, the mode shapes on the mesh (scaled to a visible amplitude) and all the modes in one binary field file
+    std::string outPrefix = std::regex_replace(setup.outMeshPath, std::regex(".obj"), "");
+    std::ofstream valueFile(outPrefix + "_eigenvalues.txt");
+    std::ofstream modeFile(outPrefix + "_modes.bin", std::ios::binary);
+    int32_t header[2] = { numEigs, nverts };
+    modeFile.write(reinterpret_cast<const char*>(header), sizeof(header));
+    double bboxDiag = (curState.curPos.colwise().maxCoeff() - curState.curPos.colwise().minCoeff()).norm();
+    for (int i = 0; i < numEigs; i++)
+    {
+        double mu = sigma + 1.0 / nus[i];
+        if (isBuckling)
+        {
+            std::cout << "buckling mode " << i << ": load factor " << mu << std::endl;
+            valueFile << mu << std::endl;
+        }
+        else
+        {
+            std::cout << "vibration mode " << i << ": omega^2 = " << mu << ", frequency " << std::sqrt(std::max(mu, 0.0)) / (2 * igl::PI) << " Hz" << std::endl;
+            valueFile << mu << " " << std::sqrt(std::max(mu, 0.0)) / (2 * igl::PI) << std::endl;
+        }
+
+        Eigen::VectorXd fullMode;
+        model._proj.unprojectVector(modes.col(i), fullMode);
+        Eigen::Matrix<double, Eigen::Dynamic, 3, Eigen::RowMajor> modeField(nverts, 3);
+        for (int v = 0; v < nverts; v++)
+            modeField.row(v) = fullMode.segment<3>(3 * v).transpose();
+        double maxDisp = modeField.rowwise().norm().maxCoeff();
+        if (maxDisp > 0)
+            modeField /= maxDisp;
+        modeFile.write(reinterpret_cast<const char*>(modeField.data()), sizeof(double) * modeField.size());
+        Eigen::MatrixXd modePos = curState.curPos + 0.1 * bboxDiag * Eigen::MatrixXd(modeField);
+        igl::writeOBJ(outPrefix + "_mode_" + std::to_string(i) + ".obj", modePos, curState.mesh.faces());
+    }
+    std::cout << "saved " << numEigs << " modes to " << outPrefix << "_modes.bin" << std::endl;
+}
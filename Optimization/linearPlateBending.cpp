@@ -1,8 +1,52 @@
 #include  <igl/boundary_loop.h>
 #include <igl/writeOBJ.h>
 #include <igl/readOBJ.h>
+#include <fstream>
+#include <regex>
 #include "ThinShellSolver.h"
 #include "../Common/Timer.h"
+#include "LinearSolver.h"
+
+// detect H = K_s x I3 on the free DOFs: every free vertex keeps its three coordinates (clamps apply to all of them, no
+// edge DOFs), the 3 x 3 blocks are multiples of the identity and the three coordinates share the same sparsity
+static bool scalarStencil(const Eigen::SparseMatrix<double>& H, ElasticShellModel& model, int nverts, Eigen::SparseMatrix<double>& Ks)
+{
+    const int n = H.rows();
+    if (n == 0 || n % 3)
+        return false;
+    for (int k = 0; k < n / 3; k++)
+    {
+        int fullId = model._proj.fullDOF(3 * k);
+        if (fullId % 3 || fullId + 2 >= 3 * nverts || model._proj.fullDOF(3 * k + 1) != fullId + 1 || model._proj.fullDOF(3 * k + 2) != fullId + 2)
+            return false;
+    }
+
+    std::vector<Eigen::Triplet<double> > T;
+    double maxAbs = 0;
+    for (int k = 0; k < H.outerSize(); k++)
+        for (Eigen::SparseMatrix<double>::InnerIterator it(H, k); it; ++it)
+        {
+            maxAbs = std::max(maxAbs, std::abs(it.value()));
+            if (it.row() % 3 == 0 && it.col() % 3 == 0)
+                T.push_back(Eigen::Triplet<double>(it.row() / 3, it.col() / 3, it.value()));
+        }
+    Ks.resize(n / 3, n / 3);
+    Ks.setFromTriplets(T.begin(), T.end());
+
+    const double tol = 1e-12 * maxAbs;
+    int counts[3] = { 0, 0, 0 };
+    for (int k = 0; k < H.outerSize(); k++)
+        for (Eigen::SparseMatrix<double>::InnerIterator it(H, k); it; ++it)
+        {
+            int a = it.row() % 3, b = it.col() % 3;
+            double expected = (a == b) ? Ks.coeff(it.row() / 3, it.col() / 3) : 0;
+            if (std::abs(it.value() - expected) > tol)
+                return false;
+            if (a == b && std::abs(it.value()) > tol)
+                counts[a]++;
+        }
+    return counts[0] == counts[1] && counts[0] == counts[2];
+}
 
 void ThinShellSolver::linearPlateBending(const ElasticSetup& setup, ElasticState& curState, std::string filePrefix, const FullSimOptimizationParams& params)
 {
@@ -19,9 +63,121 @@ void ThinShellSolver::linearPlateBending(const ElasticSetup& setup, ElasticState
 
     Eigen::VectorXd exterForces = model.externalForces(initX);
     Eigen::SparseMatrix<double> hess = model.bendingHessian(initX);
-    Eigen::CholmodSimplicialLLT<Eigen::SparseMatrix<double> > solver(hess);
-    Eigen::VectorXd du = solver.solve(exterForces);
-    model.convertVariables2CurState(initX+du, curState); 
-    const int numNodes = curState.curPos.rows();
-    Eigen::MatrixXd dispMat = curState.curPos - curState.initialGuess;
-}
\ No newline at end of file
+    // geometric multigrid uses the bending hessians assembled on the coarse levels
+    std::vector<Eigen::SparseMatrix<double> > levelHessians;
+    if (setup.linearSolverType == "gmg" || setup.pcgPreconditioner == "gmg")
+        levelHessians = levelBendingHessians(setup, curState, filePrefix, params);
+    // a batch of load cases amortizes one supernodal factorization over the multi-RHS solve
+    const bool isBatch = setup.loadCases.size() > 0;
+    const bool isAutoSolver = setup.linearSolverType == "" || setup.linearSolverType == "auto";
+
+    // the isotropic stencils give H = K_s x I3, then only the scalar matrix is kept and factorized (the DOF groups and
+    // the level hessians of the block preconditioners do not apply to it)
+    const bool isGroupedSolver = setup.linearSolverType == "gmg" || (setup.linearSolverType == "pcg" && setup.pcgPreconditioner != "jacobi" && setup.pcgPreconditioner != "ic");
+    Eigen::SparseMatrix<double> scalarHess;
+    const bool isScalar = !isGroupedSolver && scalarStencil(hess, model, curState.curPos.rows(), scalarHess);
+    if (isScalar)
+    {
+        std::cout << "the bending hessian is K_s x I3, use the " << scalarHess.rows() << " x " << scalarHess.rows() << " scalar matrix (" << scalarHess.nonZeros() << " instead of " << hess.nonZeros() << " nonzeros)" << std::endl;
+        hess = scalarHess;
+        scalarHess.resize(0, 0);
+    }
+
+    std::shared_ptr<LinearSolver> solver;
+    if (isBatch && isAutoSolver && hess.rows() < 1000000)
+        solver = createLinearSolver("cholmod_supernodal", hess.rows());
+    else if (isScalar)
+    {
+        // the scalar matrix has no edge DOFs left to eliminate, schur solves it with its vertex backend
+        const std::string& type = setup.linearSolverType == "schur" ? setup.schurSolverType : setup.linearSolverType;
+        solver = createLinearSolver(type, hess.rows(), setup.pcgTolerance, setup.pcgMaxIterations, setup.pcgPreconditioner);
+    }
+    else
+        solver = buildLinearSolver(setup, model, hess.rows(), levelHessians);
+    hess.makeCompressed();
+    Timer timer;
+    timer.start();
+    if (!solver->compute(hess))
+        std::cout << solver->name() << " failed to factorize the bending hessian." << std::endl;
+    timer.stop();
+    std::cout << solver->name() << " factorization took " << timer.elapsedSeconds() << " seconds" << std::endl;
+
+    // with the scalar matrix every right-hand side becomes three, one per coordinate: rhs(3 i + a, c) -> (i, 3 c + a)
+    auto solveAll = [&](const Eigen::MatrixXd& rhs)
+    {
+        if (!isScalar)
+            return Eigen::MatrixXd(solver->solve(rhs));
+        const int m = rhs.rows() / 3;
+        Eigen::MatrixXd scalarRhs(m, 3 * rhs.cols());
+        for (int c = 0; c < rhs.cols(); c++)
+            scalarRhs.middleCols<3>(3 * c) = Eigen::Map<const Eigen::Matrix<double, Eigen::Dynamic, 3, Eigen::RowMajor> >(rhs.col(c).data(), m, 3);
+        Eigen::MatrixXd scalarSol = solver->solve(scalarRhs);
+        Eigen::MatrixXd sol(rhs.rows(), rhs.cols());
+        for (int c = 0; c < rhs.cols(); c++)
+            Eigen::Map<Eigen::Matrix<double, Eigen::Dynamic, 3, Eigen::RowMajor> >(sol.col(c).data(), m, 3) = scalarSol.middleCols<3>(3 * c);
+        return sol;
+    };
+
+    if (!isBatch)
+    {
+        Eigen::VectorXd du = solveAll(exterForces).col(0);
+        model.convertVariables2CurState(initX+du, curState); 
+        const int numNodes = curState.curPos.rows();
+        Eigen::MatrixXd dispMat = curState.curPos - curState.initialGuess;
+        return;
+    }
+
+    // one column per load case: the pressure and gravity of the setup plus the point forces of the case
+    model._setup.pointForces.clear();
+    Eigen::MatrixXd loads = loadCaseGradients(setup, model, curState);
+    loads.colwise() += model.externalForces(initX);
+    const int numCases = loads.cols();
+
+    timer.start();
+    Eigen::MatrixXd du = solveAll(loads);
+    timer.stop();
+    std::cout << "solved " << numCases << " load cases in " << timer.elapsedSeconds() << " seconds" << std::endl;
+
+    saveLoadCases(setup, model, initX, du, curState);
+    model.convertVariables2CurState(initX + du.col(0), curState); // visualization
+}
+
+Eigen::MatrixXd ThinShellSolver::loadCaseGradients(const ElasticSetup& setup, ElasticShellModel& model, const ElasticState& curState)
+{
+    const int fullDOFs = 3 * curState.curPos.rows() + curState.curEdgeDOFs.size();
+    Eigen::MatrixXd grads;
+    for (int c = 0; c < setup.loadCases.size(); c++)
+    {
+        Eigen::VectorXd fullGrad = Eigen::VectorXd::Zero(fullDOFs);
+        for (const auto& pair : setup.loadCases[c])
+            fullGrad(pair.first) -= pair.second;
+        Eigen::VectorXd grad;
+        model._proj.projectVector(fullGrad, grad);
+        if (c == 0)
+            grads.resize(grad.size(), setup.loadCases.size());
+        grads.col(c) = grad;
+    }
+    return grads;
+}
+
+void ThinShellSolver::saveLoadCases(const ElasticSetup& setup, ElasticShellModel& model, const Eigen::VectorXd& x, const Eigen::MatrixXd& du, const ElasticState& curState)
+{
+    // int32 number of cases, int32 number of vertices, then per case the nverts x 3 displacements (doubles, row major)
+    const int numCases = du.cols();
+    const int nverts = curState.curPos.rows();
+    std::string batchPath = std::regex_replace(setup.outMeshPath, std::regex(".obj"), "") + "_load_cases.bin";
+    std::ofstream ofs(batchPath, std::ios::binary);
+    int32_t header[2] = { numCases, nverts };
+    ofs.write(reinterpret_cast<const char*>(header), sizeof(header));
+    ElasticState caseState;
+    for (int c = 0; c < numCases; c++)
+    {
+        model.convertVariables2CurState(x + du.col(c), caseState);
+        Eigen::Matrix<double, Eigen::Dynamic, 3, Eigen::RowMajor> dispMat = caseState.curPos - curState.initialGuess;
+        ofs.write(reinterpret_cast<const char*>(dispMat.data()), sizeof(double) * dispMat.size());
+    }
+    if (!ofs)
+        std::cout << "failed to write " << batchPath << std::endl;
+    else
+        std::cout << "saved the displacements of " << numCases << " load cases to " << batchPath << std::endl;
+}
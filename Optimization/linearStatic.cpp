@@ -0,0 +1,82 @@
+#include <igl/writeOBJ.h>
+#include "ThinShellSolver.h"
+#include "../Common/Timer.h"
+#include "LinearSolver.h"
+
+void ThinShellSolver::linearStaticSolver(const ElasticSetup& setup, ElasticState& curState, std::string filePrefix, const FullSimOptimizationParams& params)
+{
+    ElasticShellModel model;
+    bool ok = model.initialization(setup, curState, filePrefix, params.isProjH, params.isParallel);
+    if (!ok)
+    {
+        std::cout << "initialization failed." << std::endl;
+        return;
+    }
+    Eigen::VectorXd initX;
+    model.convertCurState2Variables(curState, initX);
+
+    // tangent stiffness at the initial state: membrane and bending hessians plus the load stiffness (pressure, penalty)
+    Timer timer;
+    timer.start();
+    Eigen::SparseMatrix<double> K;
+    if (setup.bendingType == "midEdgeShell")
+        model.hessian(initX, K);
+    else
+        K = model.membraneHessian(initX) + model.bendingHessian(initX) + model.exterHessian(initX);
+    K.makeCompressed();
+    timer.stop();
+    double assemblingTime = timer.elapsedSeconds();
+
+    // a batch of load cases amortizes one supernodal factorization over the multi-RHS solve
+    const bool isBatch = setup.loadCases.size() > 0;
+    std::shared_ptr<LinearSolver> solver;
+    if (isBatch && (setup.linearSolverType == "" || setup.linearSolverType == "auto") && K.rows() < 1000000)
+        solver = createLinearSolver("cholmod_supernodal", K.rows());
+    else
+        solver = buildLinearSolver(setup, model, K.rows());
+    timer.start();
+    if (!solver->compute(K))
+    {
+        std::cout << solver->name() << " failed to factorize the tangent stiffness, fall back to eigen_ldlt." << std::endl;
+        solver = createLinearSolver("eigen_ldlt", K.rows());
+        if (!solver->compute(K))
+        {
+            std::cout << "the tangent stiffness is singular, check the clamped DOFs." << std::endl;
+            return;
+        }
+    }
+    timer.stop();
+    double factorizationTime = timer.elapsedSeconds();
+
+    // residuals at the initial state, one column per load case (the setup point forces if there are none)
+    auto residual = [&]()
+    {
+        Eigen::VectorXd grad;
+        if (setup.bendingType == "midEdgeShell")
+            model.gradient(initX, grad);
+        else
+            grad = model.membraneGrad(initX) + model.bendingGrad(initX) + model.externalForces(initX);
+        return grad;
+    };
+    Eigen::MatrixXd residuals;
+    if (isBatch)
+    {
+        model._setup.pointForces.clear();
+        residuals = loadCaseGradients(setup, model, curState);
+        residuals.colwise() += residual();
+    }
+    else
+        residuals = residual();
+
+    timer.start();
+    Eigen::MatrixXd du = solver->solve(Eigen::MatrixXd(-residuals));
+    timer.stop();
+    double solvingTime = timer.elapsedSeconds();
+
+    std::cout << "linear static analysis with " << solver->name() << ": " << du.cols() << " load cases, " << K.rows() << " DOFs, assembling took " << assemblingTime << ", factorization took " << factorizationTime << ", back substitution took " << solvingTime << " seconds" << std::endl;
+
+    if (isBatch)
+        saveLoadCases(setup, model, initX, du, curState);
+    model.convertVariables2CurState(initX + du.col(0), curState);
+    igl::writeOBJ(setup.outMeshPath, curState.curPos, curState.mesh.faces());
+}
@@ -0,0 +1,118 @@
+#include <deque>
+#include "ThinShellSolver.h"
+#include "../Common/Timer.h"
+#include "LinearSolver.h"
+
+// first order guess of the first load step: solve K du = -(dlambda) dR/dlambda at the initial state. The later steps take
+// their guess from the last tangent factorization of quasiStaticNewtonSolver
+static void tangentPredictor(const ElasticSetup& setup, ElasticState& curState, std::string filePrefix, const FullSimOptimizationParams& params, double lambda, double dLambda)
+{
+    ElasticShellModel model;
+    bool ok = model.initialization(setup, curState, filePrefix, params.isProjH, params.isParallel);
+    if (!ok)
+        return;
+    Eigen::VectorXd x;
+    model.convertCurState2Variables(curState, x);
+
+    auto residual = [&](double loadFactor)
+    {
+        model._loadFactor = loadFactor;
+        Eigen::VectorXd grad;
+        if (setup.bendingType == "midEdgeShell")
+            model.gradient(x, grad);
+        else
+            grad = model.membraneGrad(x) + model.bendingGrad(x) + model.externalForces(x);
+        return grad;
+    };
+    // R is linear in the load factor
+    Eigen::VectorXd q = residual(1.0) - residual(0.0);
+
+    model._loadFactor = lambda;
+    Eigen::SparseMatrix<double> K;
+    if (setup.bendingType == "midEdgeShell")
+        model.hessian(x, K);
+    else
+        K = model.membraneHessian(x) + model.bendingHessian(x) + model.exterHessian(x);
+    K.makeCompressed();
+
+    std::shared_ptr<LinearSolver> solver = ThinShellSolver::buildLinearSolver(setup, model, x.size());
+    solver->analyzePatternIfChanged(K);
+    if (!solver->factorize(K))
+    {
+        solver = createLinearSolver("eigen_ldlt", x.size());
+        solver->analyzePatternIfChanged(K);
+        if (!solver->factorize(K))
+        {
+            std::cout << "tangent predictor: factorization failed, start from the last converged state." << std::endl;
+            return;
+        }
+    }
+    Eigen::VectorXd du = solver->solve(Eigen::VectorXd(-dLambda * q));
+    if (!std::isfinite(du.norm()))
+        return;
+    model._loadFactor = 1.0;
+    model.convertVariables2CurState(x + du, curState);
+}
+
+void ThinShellSolver::loadSteppingSolver(const ElasticSetup& setup, ElasticState& curState, std::string filePrefix, const FullSimOptimizationParams& params)
+{
+    const int numSteps = std::max(1, setup.numInterp);
+    const std::string& predictor = setup.loadStepPredictor;
+    if (predictor != "none" && predictor != "linear" && predictor != "quadratic" && predictor != "tangent")
+        std::cout << "unknown load step predictor " << predictor << ", use none." << std::endl;
+
+    // converged positions and edge DOFs of the last steps, newest last; the initial state is the unloaded one
+    std::deque<Eigen::MatrixXd> posHistory;
+    std::deque<Eigen::VectorXd> edgeDOFsHistory;
+    posHistory.push_back(curState.curPos);
+    edgeDOFsHistory.push_back(curState.curEdgeDOFs);
+
+    // guess of the next step from the converged tangent of the current one (tangent predictor)
+    ElasticState predictedState;
+    bool isPredicted = false;
+
+    int totalIters = 0;
+    Timer timer;
+    timer.start();
+    for (int k = 1; k <= numSteps; k++)
+    {
+        double lambda = double(k) / numSteps;
+        double dLambda = 1.0 / numSteps;
+
+        // the steps are uniform in the load factor, so the extrapolations have constant coefficients
+        int n = posHistory.size();
+        if (predictor == "quadratic" && n >= 3)
+        {
+            curState.curPos = 3 * posHistory[n - 1] - 3 * posHistory[n - 2] + posHistory[n - 3];
+            curState.curEdgeDOFs = 3 * edgeDOFsHistory[n - 1] - 3 * edgeDOFsHistory[n - 2] + edgeDOFsHistory[n - 3];
+        }
+        else if ((predictor == "linear" || predictor == "quadratic") && n >= 2)
+        {
+            curState.curPos = 2 * posHistory[n - 1] - posHistory[n - 2];
+            curState.curEdgeDOFs = 2 * edgeDOFsHistory[n - 1] - edgeDOFsHistory[n - 2];
+        }
+        else if (predictor == "tangent" && isPredicted)
+        {
+            curState.curPos = predictedState.curPos;
+            curState.curEdgeDOFs = predictedState.curEdgeDOFs;
+        }
+        else if (predictor == "tangent")
+            tangentPredictor(setup, curState, filePrefix, params, lambda - dLambda, dLambda);
+
+        bool isNextPredicted = predictor == "tangent" && k < numSteps;
+        int iters = quasiStaticNewtonSolver(setup, curState, filePrefix, params, lambda, dLambda, isNextPredicted ? &predictedState : nullptr);
+        isPredicted = isNextPredicted;
+        totalIters += iters;
+        std::cout << "load step " << k << " / " << numSteps << ": load factor " << lambda << ", predictor: " << predictor << ", Newton iterations: " << iters << std::endl;
+
+        posHistory.push_back(curState.curPos);
+        edgeDOFsHistory.push_back(curState.curEdgeDOFs);
+        if (posHistory.size() > 3)
+        {
+            posHistory.pop_front();
+            edgeDOFsHistory.pop_front();
+        }
+    }
+    timer.stop();
+    std::cout << "load stepping: " << numSteps << " steps, " << totalIters << " Newton iterations, took " << timer.elapsedSeconds() << " seconds" << std::endl;
+}
@@ -3,6 +3,9 @@
 #include <igl/readOBJ.h>
 #include "ThinShellSolver.h"
 #include "NewtonDescent.h"
+#include "LBFGSSolver.h"
+#include "TrustRegionSolver.h"
+#include "../Common/Timer.h"
 
 void ThinShellSolver::fullSimNewtonStaticSolver(const ElasticSetup& setup, ElasticState& curState, std::string filePrefix, const FullSimOptimizationParams& params)
 {
@@ -38,6 +41,12 @@ void ThinShellSolver::fullSimNewtonStaticSolver(const ElasticSetup& setup, Elast
 	Eigen::SparseMatrix<double> bendingHess;
 	std::function<double(const Eigen::VectorXd&, Eigen::VectorXd*, Eigen::SparseMatrix<double>*, bool)> elasticFunc;
 
+	// the tension field regimes are refreshed with every hessian, the count is printed with the solver's iteration log
+	int numRegimeSwitches = 0;
+	std::function<void()> regimeLog = nullptr;
+	if (setup.strecthingType == "tensionField")
+		regimeLog = [&]() { std::cout << "faces switching tension field regime: " << numRegimeSwitches << std::endl; };
+
 	if (setup.bendingType == "EP" || setup.bendingType == "ES" 
 		|| setup.bendingType == "QS" || setup.bendingType == "CS"
 		|| setup.bendingType == "FP" || setup.bendingType == "SS" 
@@ -52,7 +61,11 @@ void ThinShellSolver::fullSimNewtonStaticSolver(const ElasticSetup& setup, Elast
 			if(deriv)
 				*deriv = model.membraneGrad(x) + model.bendingGrad(x) + model.externalForces(x);
 			if (hess)
+			{
 				*hess = model.membraneHessian(x) + bendingHess + model.exterHessian(x);
+				if (setup.strecthingType == "tensionField")
+					numRegimeSwitches = model.updateTensionFieldRegimes();
+			}
 			return energy;
 		};
 	}
@@ -66,12 +79,79 @@ void ThinShellSolver::fullSimNewtonStaticSolver(const ElasticSetup& setup, Elast
 			if(deriv)
 				model.gradient(x, *deriv);
 			if (hess)
+			{
 				model.hessian(x, *hess);
+				if (setup.strecthingType == "tensionField")
+					numRegimeSwitches = model.updateTensionFieldRegimes();
+			}
 			return energy;
 		};
 	}
 
-    OptSolver::newtonSolver(elasticFunc, initX, params.iterations, params.gradNorm, params.xDelta, params.fDelta, params.printLog);
+    // bending hessian plus the membrane stiffness at the rest state, factorized once
+    auto restStiffnessFactorization = [&]()
+    {
+        ElasticState restState = curState;
+        if (setup.restV.rows() == restState.curPos.rows())
+            restState.curPos = setup.restV;
+        Eigen::VectorXd restX;
+        model.convertCurState2Variables(restState, restX);
+
+        Timer timer;
+        timer.start();
+        Eigen::SparseMatrix<double> M = model.membraneHessian(restX) + (bendingHess.rows() ? bendingHess : model.bendingHessian(restX));
+        auto precon = std::make_shared<FactorizationPreconditioner>(M);
+        timer.stop();
+        std::cout << "rest stiffness factorization took: " << timer.elapsedSeconds() << std::endl;
+        return precon;
+    };
+
+    if (setup.linearConstraints.size() && params.solverType != Newton)
+        std::cout << "linear constraints are only enforced by the Newton solver, ignored." << std::endl;
+    if (params.solverType == Lbfgs)
+    {
+        // one gradient and one back-substitution per iteration
+        LBFGSSolverOptions lbfgsOptions;
+        lbfgsOptions.initialHessianInverse = restStiffnessFactorization();
+        lbfgsOptions.lineSearch = setup.lineSearch;
+        lbfgsOptions.lineSearchMaxEvals = setup.lineSearchMaxEvals;
+        OptSolver::lbfgsSolver(elasticFunc, initX, params.iterations, params.gradNorm, params.xDelta, params.fDelta, params.printLog, nullptr, nullptr, nullptr, nullptr, lbfgsOptions);
+    }
+    else if (params.solverType == TrustRegion)
+    {
+        // truncated CG on the actual hessian, the block Jacobi preconditioner stays SPD when the hessian is indefinite
+        TrustRegionSolverOptions trustRegionOptions;
+        trustRegionOptions.preconditioner = createPreconditioner("block_jacobi", model.dofNodeMap());
+        trustRegionOptions.cgMaxIterations = setup.pcgMaxIterations;
+        trustRegionOptions.iterationLog = regimeLog;
+        OptSolver::trustRegionSolver(elasticFunc, initX, params.iterations, params.gradNorm, params.xDelta, params.fDelta, params.printLog, nullptr, nullptr, nullptr, nullptr, trustRegionOptions);
+    }
+    else
+    {
+        NewtonSolverOptions newtonOptions;
+        if (setup.linearConstraints.size())
+        {
+            Eigen::SparseMatrix<double> A = model.buildLinearConstraints();
+            if (A.rows() > 0)
+                newtonOptions.constraintBasis = sparseNullspace(A);
+        }
+        if (newtonOptions.constraintBasis.cols() > 0)
+            newtonOptions.linearSolver = buildLinearSolver(setup, model, newtonOptions.constraintBasis.cols());
+        else if (setup.linearSolverType == "pcg" && setup.pcgPreconditioner == "bending")
+        {
+            // precondition CG on the true tangent with the rest stiffness
+            newtonOptions.linearSolver = std::make_shared<PCGLinearSolver>(setup.pcgTolerance, setup.pcgMaxIterations, restStiffnessFactorization());
+        }
+        else
+            newtonOptions.linearSolver = buildLinearSolver(setup, model, initX.size());
+        newtonOptions.isMatrixFreeHessian = setup.isMatrixFreeHessian;
+        newtonOptions.isInexactNewton = setup.isInexactNewton;
+        newtonOptions.isLazyHessian = setup.isLazyHessian;
+        newtonOptions.lineSearch = setup.lineSearch;
+        newtonOptions.lineSearchMaxEvals = setup.lineSearchMaxEvals;
+        newtonOptions.iterationLog = regimeLog;
+        OptSolver::newtonSolver(elasticFunc, initX, params.iterations, params.gradNorm, params.xDelta, params.fDelta, params.printLog, nullptr, nullptr, nullptr, nullptr, newtonOptions);
+    }
     model.convertVariables2CurState(initX, curState);
 	igl::writeOBJ(setup.outMeshPath, curState.curPos, curState.mesh.faces());
 }
\ No newline at end of file
@@ -1,8 +1,11 @@
+#include <deque>
 #include  <igl/boundary_loop.h>
 #include <igl/writeOBJ.h>
 #include <igl/readOBJ.h>
 #include "ThinShellSolver.h"
 #include "../Common/Timer.h"
+#include "LinearSolver.h"
+#include "NewtonDescent.h"
 
 const Eigen::VectorXd posMat2Vector(const ElasticSetup& setup, const ElasticState& curState) 
 {
@@ -24,7 +27,7 @@ const Eigen::VectorXd posMat2Vector(const ElasticSetup& setup, const ElasticStat
     return fullX;
 }
 
-void ThinShellSolver::quasiStaticNewtonSolver(const ElasticSetup& setup, ElasticState& curState, std::string filePrefix, const FullSimOptimizationParams& params)
+int ThinShellSolver::quasiStaticNewtonSolver(const ElasticSetup& setup, ElasticState& curState, std::string filePrefix, const FullSimOptimizationParams& params, double loadFactor, double nextLoadIncrement, ElasticState* predictedState)
 {
     const int maxNewIter = params.iterations;
     const double absTol = 0.0;
@@ -37,8 +40,9 @@ void ThinShellSolver::quasiStaticNewtonSolver(const ElasticSetup& setup, Elastic
 	if (!ok)
     {
         std::cout << "initialization failed." << std::endl;
-        return;
+        return 0;
     }
+    model._loadFactor = loadFactor;
     Eigen::VectorXd initX; 
 	model.convertCurState2Variables(curState, initX);
 
@@ -50,24 +54,72 @@ void ThinShellSolver::quasiStaticNewtonSolver(const ElasticSetup& setup, Elastic
     
     Eigen::VectorXd u = Eigen::VectorXd::Zero(dofs_ - setup.clampedDOFs.size());
 
+    // linear constraints: the steps stay in the null space du = T dq, the equilibrium is T^T grad = 0 (the rest are reactions)
+    Eigen::SparseMatrix<double> T, TT;
+    std::unique_ptr<CongruenceProduct> reducedHessian;
+    if (setup.linearConstraints.size())
+    {
+        Eigen::SparseMatrix<double> A = model.buildLinearConstraints();
+        if (A.rows() > 0)
+        {
+            T = sparseNullspace(A);
+            TT = T.transpose();
+            reducedHessian = std::make_unique<CongruenceProduct>(T);
+        }
+    }
+    const bool isConstrained = T.cols() > 0;
+    auto reduceVector = [&](const Eigen::VectorXd& v) { return isConstrained ? Eigen::VectorXd(TT * v) : v; };
+    const int numReduced = isConstrained ? T.cols() : u.size();
+
     Eigen::VectorXd exterForces;
     model.externalForces(initX, exterForces);
+    exterForces = reduceVector(exterForces);
 
     // Precompute bending Hessian if not using "midEdgeShell" bending
     Eigen::SparseMatrix<double> bendingHess;
     if (setup.bendingType != "midEdgeShell") {
         bendingHess = model.bendingHessian(initX);
     }
-    bool convergence = false;
-    for (int i = 0; i < params.iterations; i++)
+    // the tangent is indefinite away from the equilibrium, so auto keeps the LDLT of the force equilibrium path rather than
+    // paying for a failed Cholesky before every LDLT
+    bool isAuto = setup.linearSolverType.empty() || setup.linearSolverType == "auto";
+    std::shared_ptr<LinearSolver> solver = isAuto ? createLinearSolver("eigen_ldlt", numReduced) : buildLinearSolver(setup, model, numReduced);
+    PCGLinearSolver* pcgSolver = dynamic_cast<PCGLinearSolver*>(solver.get());
+    // the forcing terms change the PCG tolerance during the solve, it is restored (and the operator cleared) before returning
+    const double pcgTolerance = pcgSolver ? pcgSolver->tolerance() : setup.pcgTolerance;
+    ForcingTerm forcing;
+    forcing.etaMin = pcgTolerance;
+    if (setup.isInexactNewton && !pcgSolver)
+        std::cout << "inexact Newton needs the pcg linear solver, " << solver->name() << " solves exactly." << std::endl;
+    int totalInnerIters = 0;
+
+    auto residual = [&](const Eigen::VectorXd& x)
     {
         Eigen::VectorXd grad;
         if (setup.bendingType == "midEdgeShell") {
-            model.gradient(initX + u, grad);
+            model.gradient(x, grad);
         } else {
-            grad = model.membraneGrad(initX + u) + model.bendingGrad(initX + u) + model.externalForces(initX + u);
+            grad = model.membraneGrad(x) + model.bendingGrad(x) + model.externalForces(x);
         }
-        Eigen::VectorXd rhs_bc = - grad;
+        return grad;
+    };
+    std::shared_ptr<LinearSolver> ldltSolver;
+    std::shared_ptr<LinearSolver> tangentSolver;    // the solver holding the last tangent factorization
+    bool isLDLTFallback = false;    // once the chosen solver failed on the tangent, the remaining iterations go to LDLT directly
+
+    // Anderson acceleration over the fixed point map u -> u + du(u): the last updates f_j = du_j and images g_j = u_j + du_j
+    std::deque<Eigen::VectorXd> andersonF, andersonG;
+    int numAccepted = 0;
+    Eigen::VectorXd nextGrad;
+
+    bool convergence = false;
+    int numIters = 0;
+    for (int i = 0; i < params.iterations; i++)
+    {
+        // the residual at the current iterate is already known if the Anderson safeguard ran
+        Eigen::VectorXd grad = nextGrad.size() ? nextGrad : residual(initX + u);
+        nextGrad.resize(0);
+        Eigen::VectorXd rhs_bc = - reduceVector(grad);
 
         const double rhs_norm = rhs_bc.norm();  
         const double exterF_norm = exterForces.norm();
@@ -87,9 +139,58 @@ void ThinShellSolver::quasiStaticNewtonSolver(const ElasticSetup& setup, Elastic
         else {
             hess = model.membraneHessian(initX + u) + bendingHess + model.exterHessian(initX + u);
         }
+        if (isConstrained)
+        {
+            Eigen::SparseMatrix<double> fullHess = std::move(hess);
+            reducedHessian->compute(fullHess, hess);
+        }
 
-        Eigen::SimplicialLDLT<Eigen::SparseMatrix<double>> solver(hess);
-        Eigen::VectorXd du = solver.solve(rhs_bc);
+        Eigen::VectorXd du;
+        hess.makeCompressed();
+        bool isSolved = false;
+        if (!isLDLTFallback)
+        {
+            solver->analyzePatternIfChanged(hess);
+            if (pcgSolver && setup.isMatrixFreeHessian)
+            {
+                // tangent-vector products by finite differences of the residual, the assembled tangent only builds the preconditioner
+                pcgSolver->setOperator([&](const Eigen::VectorXd& v)
+                {
+                    Eigen::VectorXd fullV = isConstrained ? Eigen::VectorXd(T * v) : v;
+                    double eps = std::sqrt(std::numeric_limits<double>::epsilon()) * (1.0 + (initX + u).norm()) / std::max(fullV.norm(), 1e-16);
+                    return reduceVector((residual(initX + u + eps * fullV) - grad) / eps);
+                });
+            }
+            if (pcgSolver && setup.isInexactNewton)
+                pcgSolver->setTolerance(forcing.next(rhs_norm, relTol * exterF_norm + absTol));
+            if (solver->factorize(hess) || (pcgSolver && setup.isMatrixFreeHessian))
+            {
+                du = solver->solve(rhs_bc);
+                tangentSolver = solver;
+                if (pcgSolver)
+                {
+                    totalInnerIters += pcgSolver->lastIterations();
+                    std::cout << "PCG iterations: " << pcgSolver->lastIterations() << " (total: " << totalInnerIters << "), tolerance: " << pcgSolver->tolerance() << ", relative residual: " << pcgSolver->lastRelativeResidual() << std::endl;
+                }
+                // CG only meets the indefiniteness while solving, its truncated iterate is not a Newton step
+                isSolved = !solver->isIndefiniteDetected();
+            }
+        }
+        if (!isSolved)
+        {
+            // the tangent is indefinite away from the equilibrium, which LLT and CG cannot handle
+            if (!isLDLTFallback)
+                std::cout << solver->name() << " failed on the tangent stiffness, fall back to eigen_ldlt for the remaining iterations." << std::endl;
+            isLDLTFallback = true;
+            if (!ldltSolver)
+                ldltSolver = createLinearSolver("eigen_ldlt", numReduced);
+            ldltSolver->analyzePatternIfChanged(hess);
+            ldltSolver->factorize(hess);
+            du = ldltSolver->solve(rhs_bc);
+            tangentSolver = ldltSolver;
+        }
+        if (isConstrained)
+            du = T * du;
 
         const double du_infiNorm = du.cwiseAbs().maxCoeff(); 
         if (du_infiNorm >= LSstepSize)
@@ -97,15 +198,86 @@ void ThinShellSolver::quasiStaticNewtonSolver(const ElasticSetup& setup, Elastic
             du = LSstepSize / du_infiNorm * du;
         }
 
-        u = u + du;
+        Eigen::VectorXd uNew = u + du;
+        if (setup.andersonDepth > 0 && !convergence)
+        {
+            andersonF.push_back(du);
+            andersonG.push_back(uNew);
+            if (andersonF.size() > setup.andersonDepth + 1)
+            {
+                andersonF.pop_front();
+                andersonG.pop_front();
+            }
+            int m = andersonF.size() - 1;
+            if (m > 0)
+            {
+                Eigen::MatrixXd dF(du.size(), m), dG(du.size(), m);
+                for (int j = 0; j < m; j++)
+                {
+                    dF.col(j) = andersonF[j + 1] - andersonF[j];
+                    dG.col(j) = andersonG[j + 1] - andersonG[j];
+                }
+                Eigen::VectorXd gamma = dF.colPivHouseholderQr().solve(du);
+                Eigen::VectorXd uAcc = uNew - dG * gamma;
+
+                // safeguard: keep the accelerated iterate only if its force residual is below the one of the plain Newton
+                // iterate, otherwise restart the history. Either residual is reused by the next iteration
+                Eigen::VectorXd accGrad = residual(initX + uAcc);
+                Eigen::VectorXd newGrad = residual(initX + uNew);
+                if (reduceVector(accGrad).norm() < reduceVector(newGrad).norm())
+                {
+                    uNew = uAcc;
+                    nextGrad = accGrad;
+                    numAccepted++;
+                    std::cout << "Anderson step accepted (depth " << m << "), accepted " << numAccepted << " times in total" << std::endl;
+                }
+                else
+                {
+                    std::cout << "Anderson step rejected, restart the history." << std::endl;
+                    nextGrad = newGrad;
+                    andersonF.erase(andersonF.begin(), andersonF.end() - 1);
+                    andersonG.erase(andersonG.begin(), andersonG.end() - 1);
+                }
+            }
+        }
+        u = uNew;
 
         if (convergence == true || i == params.iterations - 1)
         {
+            numIters = i + 1;
             model.convertVariables2CurState(initX+u, curState);
             igl::writeOBJ(setup.outMeshPath, curState.curPos, curState.mesh.faces());
             std::cout << "Convergenced! Total iteration number is: " << i << std::endl;
             break;
         }
     } // end of for loop
+    if (pcgSolver)
+    {
+        pcgSolver->setTolerance(pcgTolerance);
+        pcgSolver->setOperator(nullptr);
+    }
+
+    // tangent predictor of the next load step, K du = -(dlambda) dR/dlambda with the factorization of the tangent at the
+    // converged state (the last Newton iteration assembles it before its final correction)
+    if (predictedState)
+    {
+        *predictedState = curState;
+        if (tangentSolver)
+        {
+            // R is linear in the load factor
+            model._loadFactor = 1.0;
+            Eigen::VectorXd q = residual(initX + u);
+            model._loadFactor = 0.0;
+            q -= residual(initX + u);
+            model._loadFactor = loadFactor;
+
+            Eigen::VectorXd du = tangentSolver->solve(Eigen::VectorXd(-nextLoadIncrement * reduceVector(q)));
+            if (isConstrained)
+                du = T * du;
+            if (std::isfinite(du.norm()))
+                model.convertVariables2CurState(initX + u + du, *predictedState);
+        }
+    }
     model.convertVariables2CurState(initX+u, curState); // visualization
+    return numIters;
 }
\ No newline at end of file
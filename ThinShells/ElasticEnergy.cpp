@@ -37,27 +37,7 @@ double elasticStretchingEnergy(
     auto derivs = std::vector<Eigen::Matrix<double, 1, 9>>(nfaces);
     auto hesses = std::vector<Eigen::Matrix<double, 9, 9>>(nfaces);
 
-    if (isParallel)
-    {
-        auto computeStretching = [&](const tbb::blocked_range<uint32_t>& range)
-        {
-
-            for (uint32_t i = range.begin(); i < range.end(); ++i)
-            {
-                energies[i] = mat.stretchingEnergy(mesh, curPos, lameAlpha, lameBeta, thickness, abars[i], i, derivative ? &derivs[i] : NULL, hessian ? &hesses[i] : NULL, isLocalProj);
-            }
-
-        };
-        tbb::blocked_range<uint32_t> rangex(0u, (uint32_t)nfaces);
-        tbb::parallel_for(rangex, computeStretching);
-    }
-    else
-    {
-        for (int i = 0; i < nfaces; i++)
-        {
-            energies[i] = mat.stretchingEnergy(mesh, curPos, lameAlpha, lameBeta, thickness, abars[i], i, derivative ? &derivs[i] : NULL, hessian ? &hesses[i] : NULL, isLocalProj);
-        }
-    }
+    mat.stretchingEnergies(mesh, curPos, lameAlpha, lameBeta, thickness, abars, energies, derivative ? &derivs : NULL, hessian ? &hesses : NULL, isLocalProj, isParallel);
 
     for (int i = 0; i < nfaces; i++)
     {
@@ -1,5 +1,7 @@
 #include <fstream>
 #include <string>
+#include <filesystem>
+#include <algorithm>
 #include <igl/readOBJ.h>
 #include <igl/writeOBJ.h>
 #include <igl/boundary_facets.h>
@@ -7,6 +9,157 @@
 
 #include "ElasticIO.h"
 
+#ifdef __APPLE__
+namespace fs = std::__fs::filesystem;
+#else
+namespace fs = std::filesystem;
+#endif
+
+// point forces file: the number of forces, then one "dof value" line per force (a value starting with # is skipped)
+static bool loadPointForces(std::ifstream& ifs, const std::string& path, int nverts, std::map<int, double>& pointForces)
+{
+    int nPointForces;
+    ifs >> nPointForces;
+    char dummy;
+    ifs >> dummy;
+    if (!ifs)
+    {
+        std::cout << "Error in " << path << std::endl;
+        return false;
+    }
+    ifs.ignore(std::numeric_limits<int>::max(), '\n');
+    std::cout << "num of point forces: " << nPointForces << std::endl;
+    for (int i = 0; i < nPointForces; i++)
+    {
+        std::string line;
+        std::getline(ifs, line);
+        std::stringstream ss(line);
+
+        int vid;
+        ss >> vid;
+        if (!ss || vid < 0 || vid >= 3*nverts)
+        {
+            std::cout << "Error in " << path << std::endl;
+            return false;
+        }
+        std::string x; // x, y, z
+        ss >> x;
+        if (!ss)
+        {
+            std::cout << "Error in " << path << std::endl;
+            return false;
+        }
+        
+        if (x[0] != '#')
+        {
+            pointForces[vid] = std::stod(x);
+        }            
+    }
+
+    if (!ifs)
+    {
+        std::cout << "Error in " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// linear constraints file: the number of constraints, then one per line, on the displacements u:
+//   tie v0 v1            u_v0 = u_v1 (three rows)
+//   plane v nx ny nz     n . u_v = 0, e.g. a symmetry plane
+//   link v0 v1           (x_v1 - x_v0) . (u_v1 - u_v0) = 0, a rigid link linearized at the initial positions x
+//   dofs d0 c0 d1 c1 ... sum_j c_j u_dj = 0 over the full DOF ids (the edge DOFs follow the 3 nverts vertex DOFs)
+static bool loadLinearConstraints(std::ifstream& ifs, const std::string& path, const Eigen::MatrixXd& pos, std::vector<std::map<int, double> >& constraints)
+{
+    int nverts = pos.rows();
+    int nconstraints;
+    ifs >> nconstraints;
+    if (!ifs)
+    {
+        std::cout << "Error in " << path << std::endl;
+        return false;
+    }
+    ifs.ignore(std::numeric_limits<int>::max(), '\n');
+    for (int i = 0; i < nconstraints; i++)
+    {
+        std::string line;
+        std::getline(ifs, line);
+        std::stringstream ss(line);
+
+        std::string type;
+        ss >> type;
+        if (type == "tie" || type == "link")
+        {
+            int v0, v1;
+            ss >> v0 >> v1;
+            if (!ss || v0 < 0 || v0 >= nverts || v1 < 0 || v1 >= nverts || v0 == v1)
+            {
+                std::cout << "Error in " << path << ": " << line << std::endl;
+                return false;
+            }
+            if (type == "tie")
+            {
+                for (int j = 0; j < 3; j++)
+                    constraints.push_back({ { 3 * v0 + j, 1.0 }, { 3 * v1 + j, -1.0 } });
+            }
+            else
+            {
+                Eigen::RowVector3d d = pos.row(v1) - pos.row(v0);
+                std::map<int, double> row;
+                for (int j = 0; j < 3; j++)
+                {
+                    row[3 * v0 + j] = -d[j];
+                    row[3 * v1 + j] = d[j];
+                }
+                constraints.push_back(row);
+            }
+        }
+        else if (type == "plane")
+        {
+            int v;
+            Eigen::Vector3d n;
+            ss >> v >> n[0] >> n[1] >> n[2];
+            if (!ss || v < 0 || v >= nverts)
+            {
+                std::cout << "Error in " << path << ": " << line << std::endl;
+                return false;
+            }
+            std::map<int, double> row;
+            for (int j = 0; j < 3; j++)
+                row[3 * v + j] = n[j];
+            constraints.push_back(row);
+        }
+        else if (type == "dofs")
+        {
+            std::map<int, double> row;
+            int dof;
+            double coeff;
+            while (ss >> dof >> coeff)
+            {
+                if (dof < 0)
+                {
+                    std::cout << "Error in " << path << ": " << line << std::endl;
+                    return false;
+                }
+                row[dof] += coeff;
+            }
+            constraints.push_back(row);
+        }
+        else
+        {
+            std::cout << "Error in " << path << ", unknown constraint: " << line << std::endl;
+            return false;
+        }
+    }
+    if (!ifs)
+    {
+        std::cout << "Error in " << path << std::endl;
+        return false;
+    }
+    std::cout << "num of linear constraints: " << nconstraints << " (" << constraints.size() << " rows)" << std::endl;
+    return true;
+}
+
 bool loadElastic(const std::string& path, ElasticSetup& setup, ElasticState& state)
 {
 
@@ -94,6 +247,153 @@ bool loadElastic(const std::string& path, ElasticSetup& setup, ElasticState& sta
     else
         setup.numInterp = 1;
 
+    if (jval.contains(std::string_view{ "linear_solver" }))
+    {
+        setup.linearSolverType = jval["linear_solver"];
+    }
+    else
+        setup.linearSolverType = "auto";
+
+    if (jval.contains(std::string_view{ "pcg_tolerance" }))
+    {
+        setup.pcgTolerance = jval["pcg_tolerance"];
+    }
+    else
+        setup.pcgTolerance = 1e-8;
+
+    if (jval.contains(std::string_view{ "pcg_max_iterations" }))
+    {
+        setup.pcgMaxIterations = jval["pcg_max_iterations"];
+    }
+    else
+        setup.pcgMaxIterations = 1000;
+
+    if (jval.contains(std::string_view{ "pcg_preconditioner" }))
+    {
+        setup.pcgPreconditioner = jval["pcg_preconditioner"];
+    }
+    else
+        setup.pcgPreconditioner = "jacobi";
+
+    if (jval.contains(std::string_view{ "schwarz_subdomains" }))
+    {
+        setup.schwarzSubdomains = jval["schwarz_subdomains"];
+    }
+    else
+        setup.schwarzSubdomains = 0;
+
+    if (jval.contains(std::string_view{ "schwarz_overlap" }))
+    {
+        setup.schwarzOverlap = jval["schwarz_overlap"];
+    }
+    else
+        setup.schwarzOverlap = 1;
+
+    if (jval.contains(std::string_view{ "schur_solver" }))
+    {
+        setup.schurSolverType = jval["schur_solver"];
+    }
+    else
+        setup.schurSolverType = "auto";
+
+    if (jval.contains(std::string_view{ "matrix_free_hessian" }))
+    {
+        setup.isMatrixFreeHessian = jval["matrix_free_hessian"];
+    }
+    else
+        setup.isMatrixFreeHessian = false;
+
+    if (jval.contains(std::string_view{ "inexact_newton" }))
+    {
+        setup.isInexactNewton = jval["inexact_newton"];
+    }
+    else
+        setup.isInexactNewton = false;
+
+    if (jval.contains(std::string_view{ "lazy_hessian" }))
+    {
+        setup.isLazyHessian = jval["lazy_hessian"];
+    }
+    else
+        setup.isLazyHessian = false;
+
+    if (jval.contains(std::string_view{ "anderson_depth" }))
+    {
+        setup.andersonDepth = jval["anderson_depth"];
+    }
+    else
+        setup.andersonDepth = 0;
+
+    if (jval.contains(std::string_view{ "arc_length_continuation" }))
+    {
+        setup.isArcLengthContinuation = jval["arc_length_continuation"];
+    }
+    else
+        setup.isArcLengthContinuation = false;
+
+    if (jval.contains(std::string_view{ "load_step_predictor" }))
+    {
+        setup.loadStepPredictor = jval["load_step_predictor"];
+    }
+    else
+        setup.loadStepPredictor = "none";
+
+    if (jval.contains(std::string_view{ "linear_static" }))
+    {
+        setup.isLinearStatic = jval["linear_static"];
+    }
+    else
+        setup.isLinearStatic = false;
+
+    if (jval.contains(std::string_view{ "eigen_analysis" }))
+    {
+        setup.eigenAnalysis = jval["eigen_analysis"];
+    }
+    else
+        setup.eigenAnalysis = "none";
+
+    if (jval.contains(std::string_view{ "num_eigenpairs" }))
+    {
+        setup.numEigenpairs = jval["num_eigenpairs"];
+    }
+    else
+        setup.numEigenpairs = 6;
+
+    if (jval.contains(std::string_view{ "eigen_shift" }))
+    {
+        setup.eigenShift = jval["eigen_shift"];
+    }
+    else
+        setup.eigenShift = 0;
+
+    if (jval.contains(std::string_view{ "line_search" }))
+    {
+        setup.lineSearch = jval["line_search"];
+    }
+    else
+        setup.lineSearch = "backtracking";
+
+    if (jval.contains(std::string_view{ "line_search_max_evals" }))
+    {
+        setup.lineSearchMaxEvals = jval["line_search_max_evals"];
+    }
+    else
+        setup.lineSearchMaxEvals = 50;
+
+    if (jval.contains(std::string_view{ "solver_type" }))
+    {
+        setup.solverType = jval["solver_type"];
+    }
+    else
+        setup.solverType = "newton";
+
+    if (jval.contains(std::string_view{ "subdivision_levels" }))
+    {
+        setup.subdivisionLevels = jval["subdivision_levels"];
+    }
+    else
+        setup.subdivisionLevels = 0;
+
     if (jval.contains(std::string_view{ "sff_type" }))
     {
         setup.sffType = jval["sff_type"];
@@ -121,6 +421,8 @@ bool loadElastic(const std::string& path, ElasticSetup& setup, ElasticState& sta
         std::cout << "missing the rest mesh path." << std::endl;
         return false;
     }
+    int coarseNVerts = setup.restV.rows();
+    setup.buildSubdivisionHierarchy();
     setup.buildRestFundamentalForms();
 
     Eigen::MatrixXi F;
@@ -139,6 +441,11 @@ bool loadElastic(const std::string& path, ElasticSetup& setup, ElasticState& sta
             state.initialGuess = setup.restV;
             F = setup.restF;
         }
+        else if (setup.subdivisionLevels > 0 && state.initialGuess.rows() == coarseNVerts)
+        {
+            state.initialGuess = setup.subdividePositions(state.initialGuess);
+            F = setup.restF;
+        }
     }
     state.mesh = MeshConnectivity(F);
     setup.sff->initializeExtraDOFs(state.initialEdgeDOFs, state.mesh, state.initialGuess);
@@ -158,6 +465,11 @@ bool loadElastic(const std::string& path, ElasticSetup& setup, ElasticState& sta
             state.curPos = state.initialGuess;
             state.curEdgeDOFs = state.initialEdgeDOFs;
         }
+        else if (setup.subdivisionLevels > 0 && state.curPos.rows() == coarseNVerts)
+        {
+            state.curPos = setup.subdividePositions(state.curPos);
+            F = setup.restF;
+        }
 
     }
     if ((F - state.mesh.faces()).norm() != 0)
@@ -272,6 +584,7 @@ bool loadElastic(const std::string& path, ElasticSetup& setup, ElasticState& sta
             std::cout << "Error in " << setup.clampedDOFsPath << std::endl;
             return false;
         }
+        setup.subdivideClampedDOFs();
     }
 
     // point forces
@@ -289,50 +602,65 @@ bool loadElastic(const std::string& path, ElasticSetup& setup, ElasticState& sta
             std::cout << "Missing " << setup.pointForcesPath << std::endl;
             return false;
         }
-        int nPointForces;
-        ifs >> nPointForces;
-        char dummy;
-        ifs >> dummy;
-        if (!ifs)
-        {
-            std::cout << "Error in " << setup.pointForcesPath << std::endl;
+        if (!loadPointForces(ifs, setup.pointForcesPath, nverts, setup.pointForces))
             return false;
-        }
-        ifs.ignore(std::numeric_limits<int>::max(), '\n');
-        std::cout << "num of point forces: " << nPointForces << std::endl;
-        for (int i = 0; i < nPointForces; i++)
-        {
-            std::string line;
-            std::getline(ifs, line);
-            std::stringstream ss(line);
+    }
 
-            int vid;
-            ss >> vid;
-            if (!ss || vid < 0 || vid >= 3*nverts)
+    // load cases: point force files (in the format above), given as a list or as a folder
+    setup.loadCasesPaths.clear();
+    setup.loadCases.clear();
+    if (jval.contains(std::string_view{ "load_cases" }))
+    {
+        if (jval["load_cases"].is_string())
+        {
+            std::string folder = jval["load_cases"];
+            if (!fs::is_directory(filePathPrefix + folder))
             {
-                std::cout << "Error in " << setup.pointForcesPath << std::endl;
+                std::cout << "Missing " << folder << std::endl;
                 return false;
             }
-            std::string x; // x, y, z
-            ss >> x;
-            if (!ss)
+            for (const auto& entry : fs::directory_iterator(filePathPrefix + folder))
             {
-                std::cout << "Error in " << setup.pointForcesPath << std::endl;
-                return false;
+                if (entry.is_regular_file())
+                    setup.loadCasesPaths.push_back((fs::path(folder) / entry.path().filename()).string());
             }
-            
-            if (x[0] != '#')
+            std::sort(setup.loadCasesPaths.begin(), setup.loadCasesPaths.end());
+        }
+        else
+        {
+            for (const auto& casePath : jval["load_cases"])
+                setup.loadCasesPaths.push_back(casePath);
+        }
+
+        for (const auto& casePath : setup.loadCasesPaths)
+        {
+            std::ifstream cfs(filePathPrefix + casePath);
+            if (!cfs)
             {
-                setup.pointForces[vid] = std::stod(x);
-            }            
+                std::cout << "Missing " << casePath << std::endl;
+                return false;
+            }
+            std::map<int, double> caseForces;
+            if (!loadPointForces(cfs, casePath, nverts, caseForces))
+                return false;
+            setup.loadCases.push_back(caseForces);
         }
+        std::cout << "num of load cases: " << setup.loadCases.size() << std::endl;
+    }
 
+    setup.linearConstraintsPath = "";
+    setup.linearConstraints.clear();
+    if (jval.contains(std::string_view{ "linear_constraints" }))
+    {
+        setup.linearConstraintsPath = jval["linear_constraints"];
+        std::ifstream ifs(filePathPrefix + setup.linearConstraintsPath);
         if (!ifs)
         {
-            std::cout << "Error in " << setup.pointForcesPath << std::endl;
+            std::cout << "Missing " << setup.linearConstraintsPath << std::endl;
             return false;
         }
-
+        if (!loadLinearConstraints(ifs, setup.linearConstraintsPath, state.curPos, setup.linearConstraints))
+            return false;
     }
 
     if (!jval.contains(std::string_view{ "output_mesh" }))
@@ -345,7 +673,12 @@ bool loadElastic(const std::string& path, ElasticSetup& setup, ElasticState& sta
     }
 
     state.curEdgeDOFs = state.initialEdgeDOFs;
-    if (jval.contains(std::string_view{ "curedge_DOFs" }) && state.initialEdgeDOFs.size())
+    if (jval.contains(std::string_view{ "curedge_DOFs" }) && state.initialEdgeDOFs.size() && setup.subdivisionLevels > 0)
+    {
+        setup.curEdgeDOFsPath = jval["curedge_DOFs"];
+        std::cout << "the edge dofs in " << setup.curEdgeDOFsPath << " belong to the coarse mesh, use the initial edge dofs of the subdivided mesh instead." << std::endl;
+    }
+    else if (jval.contains(std::string_view{ "curedge_DOFs" }) && state.initialEdgeDOFs.size())
     {
         setup.curEdgeDOFsPath = jval["curedge_DOFs"];
         std::string edgeDOFsPath = filePathPrefix + setup.curEdgeDOFsPath;
@@ -402,6 +735,31 @@ bool saveElastic(const std::string& path, const ElasticSetup& setup, const Elast
     json["num_interpolation"] = setup.numInterp;
 
     json["sff_type"] = setup.sffType;
+    json["linear_solver"] = setup.linearSolverType;
+    json["pcg_tolerance"] = setup.pcgTolerance;
+    json["pcg_max_iterations"] = setup.pcgMaxIterations;
+    json["pcg_preconditioner"] = setup.pcgPreconditioner;
+    json["schwarz_subdomains"] = setup.schwarzSubdomains;
+    json["schwarz_overlap"] = setup.schwarzOverlap;
+    json["schur_solver"] = setup.schurSolverType;
+    json["subdivision_levels"] = setup.subdivisionLevels;
+    json["matrix_free_hessian"] = setup.isMatrixFreeHessian;
+    json["inexact_newton"] = setup.isInexactNewton;
+    json["lazy_hessian"] = setup.isLazyHessian;
+    json["anderson_depth"] = setup.andersonDepth;
+    json["arc_length_continuation"] = setup.isArcLengthContinuation;
+    json["load_step_predictor"] = setup.loadStepPredictor;
+    json["linear_static"] = setup.isLinearStatic;
+    json["eigen_analysis"] = setup.eigenAnalysis;
+    json["num_eigenpairs"] = setup.numEigenpairs;
+    json["eigen_shift"] = setup.eigenShift;
+    json["line_search"] = setup.lineSearch;
+    json["line_search_max_evals"] = setup.lineSearchMaxEvals;
+    json["solver_type"] = setup.solverType;
+    if (setup.loadCasesPaths.size())
+        json["load_cases"] = setup.loadCasesPaths;
+    if (setup.linearConstraintsPath != "")
+        json["linear_constraints"] = setup.linearConstraintsPath;
 
     json["rest_mesh"] = setup.restMeshPath;
     json["init_mesh"] = setup.initMeshPath;
@@ -2,6 +2,7 @@
 #include <igl/boundary_loop.h>
 #include <igl/cotmatrix.h>
 #include <igl/massmatrix.h>
+#include <igl/upsample.h>
 
 #include "../MeshLib/GeometryDerivatives.h"
 #include "../MeshLib/MeshConnectivity.h"
@@ -28,6 +29,56 @@ void ElasticSetup::buildRestFundamentalForms()
     }
 }
 
+void ElasticSetup::buildSubdivisionHierarchy()
+{
+    subdivisionProlongators.clear();
+    subdivisionFaces.clear();
+    for (int l = 0; l < subdivisionLevels; l++)
+    {
+        Eigen::SparseMatrix<double> S;
+        Eigen::MatrixXi NF;
+        igl::upsample(restV.rows(), restF, S, NF);
+        subdivisionFaces.push_back(restF);
+        subdivisionProlongators.push_back(S);
+        restV = S * restV;
+        restF = NF;
+    }
+    if (subdivisionLevels > 0)
+        std::cout << "subdivided the rest mesh " << subdivisionLevels << " times: " << restV.rows() << " vertices, " << restF.rows() << " faces." << std::endl;
+}
+
+Eigen::MatrixXd ElasticSetup::subdividePositions(const Eigen::MatrixXd& coarseV) const
+{
+    Eigen::MatrixXd V = coarseV;
+    for (auto& S : subdivisionProlongators)
+        V = S * V;
+    return V;
+}
+
+void ElasticSetup::subdivideClampedDOFs()
+{
+    for (auto& S : subdivisionProlongators)
+    {
+        // the midpoint rows of S have two entries of 0.5, the original vertices keep the identity
+        Eigen::SparseMatrix<double, Eigen::RowMajor> rowS = S;
+        for (int v = S.cols(); v < S.rows(); v++)
+        {
+            std::vector<int> parents;
+            for (Eigen::SparseMatrix<double, Eigen::RowMajor>::InnerIterator it(rowS, v); it; ++it)
+                parents.push_back(it.col());
+            if (parents.size() != 2)
+                continue;
+            for (int j = 0; j < 3; j++)
+            {
+                auto it0 = clampedDOFs.find(3 * parents[0] + j);
+                auto it1 = clampedDOFs.find(3 * parents[1] + j);
+                if (it0 != clampedDOFs.end() && it1 != clampedDOFs.end())
+                    clampedDOFs[3 * v + j] = 0.5 * (it0->second + it1->second);
+            }
+        }
+    }
+}
+
 void ElasticSetup::computeVertArea(const int nverts, const Eigen::MatrixXi& stitchedF)
 {
     vertArea.resize(nverts);
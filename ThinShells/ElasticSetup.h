@@ -58,9 +58,37 @@ public:
 
 		clampedDOFsPath = "";
 		pointForcesPath = "";
+		loadCasesPaths.clear();
+		loadCases.clear();
+		linearConstraintsPath = "";
+		linearConstraints.clear();
 
 		outMeshPath = "";
-		
+
+		linearSolverType = "auto";
+		pcgTolerance = 1e-8;
+		pcgMaxIterations = 1000;
+		pcgPreconditioner = "jacobi";
+		isMatrixFreeHessian = false;
+		isInexactNewton = false;
+		isLazyHessian = false;
+		andersonDepth = 0;
+		isArcLengthContinuation = false;
+		loadStepPredictor = "none";
+		isLinearStatic = false;
+		eigenAnalysis = "none";
+		numEigenpairs = 6;
+		eigenShift = 0;
+		lineSearch = "backtracking";
+		lineSearchMaxEvals = 50;
+		solverType = "newton";
+		schwarzSubdomains = 0;
+		schwarzOverlap = 1;
+		schurSolverType = "auto";
+
+		subdivisionLevels = 0;
+		subdivisionProlongators.clear();
+		subdivisionFaces.clear();
 	}
 
 public:
@@ -73,6 +101,8 @@ public:
 	Eigen::SparseMatrix<double> laplacian;
 	std::map<int, double> clampedDOFs;
 	std::map<int, double> pointForces;
+	std::vector<std::map<int, double> > loadCases;	// point forces of each load case, solved together by linearPlateBending
+	std::vector<std::map<int, double> > linearConstraints;	// rows sum_j c_j du_j = 0 over the full DOF ids, du is the displacement of a solve
 
 	std::string sffType;
 	std::shared_ptr<SecondFundamentalFormDiscretization> sff;
@@ -105,10 +135,45 @@ public:
 	//vert area
 	std::vector<double> vertArea;
 
+	// linear solver backend: auto, cholmod_supernodal, cholmod_simplicial, eigen_llt, eigen_ldlt, mixed_ldlt, pcg, gmg or schur
+	std::string linearSolverType;
+	double pcgTolerance;	// relative residual
+	int pcgMaxIterations;
+	std::string pcgPreconditioner;	// jacobi, block_jacobi, ic, amg, gmg, schwarz or bending
+	int schwarzSubdomains;	// schwarz preconditioner: number of subdomains, 0 is one per hardware thread
+	int schwarzOverlap;	// schwarz preconditioner: layers of faces added around each subdomain
+	std::string schurSolverType;	// schur: backend of the vertex system (any linear solver type but gmg and schur)
+	bool isMatrixFreeHessian;	// PCG products through finite differences of the gradient, the assembled hessian only builds the preconditioner
+	bool isInexactNewton;	// PCG tolerance from Eisenstat-Walker forcing terms, pcgTolerance is the lower bound
+	bool isLazyHessian;	// modified Newton: reuse the last factorization while the steps converge fast enough
+	int andersonDepth;	// quasi-static solver: number of previous updates used by Anderson acceleration, 0 is off
+	bool isArcLengthContinuation;	// ramp the loads by arc length continuation, numInterp only sets the first increment
+	std::string loadStepPredictor;	// initial guess of each load step: none, linear, quadratic or tangent
+	bool isLinearStatic;	// one linear solve with the tangent stiffness of the initial state, for the loads or the load cases
+	std::string eigenAnalysis;	// none, modal or buckling
+	int numEigenpairs;
+	double eigenShift;	// shift-invert target, the eigenvalues closest to it are computed
+	std::string lineSearch;	// Newton and L-BFGS: backtracking or interpolation
+	int lineSearchMaxEvals;	// energy evaluations allowed per line search
+	std::string solverType;	// newton (quasi-static load stepping), lbfgs or trust_region (full simulation)
+
+	// uniform midpoint refinement of the input meshes, the coarser levels are kept for geometric multigrid
+	int subdivisionLevels;
+	std::vector<Eigen::SparseMatrix<double> > subdivisionProlongators;	// vertex prolongation from level l to l + 1, coarsest first
+	std::vector<Eigen::MatrixXi> subdivisionFaces;	// faces of the coarse levels, the finest level uses restF
+
 	std::string restMeshPath, obstaclePath, initMeshPath, curMeshPath, curEdgeDOFsPath, clampedDOFsPath, pointForcesPath, outMeshPath;
+	std::vector<std::string> loadCasesPaths;
+	std::string linearConstraintsPath;
 
 public:
 	void buildRestFundamentalForms();
 	void computeVertArea(const int nverts, const Eigen::MatrixXi& stitchedF);
+	// refine restV/restF subdivisionLevels times (the original vertices keep their indices), and store the hierarchy
+	void buildSubdivisionHierarchy();
+	// prolongate the vertex positions of the coarsest level to the finest one
+	Eigen::MatrixXd subdividePositions(const Eigen::MatrixXd& coarseV) const;
+	// clamp the new midpoints whose two parents are clamped, at the average of the parent values
+	void subdivideClampedDOFs();
 	void computeLaplacian(const Eigen::MatrixXd restV, const Eigen::MatrixXi restF, const std::vector<Eigen::Vector3i>& bnd_edges, const Eigen::VectorXi& newIndex, const double nverts);
 };
@@ -11,6 +11,7 @@
 
 #include <igl/cotmatrix.h>
 #include <igl/boundary_loop.h>
+#include <tbb/tbb.h>
 
 #include "ElasticShellMaterial.h"
 #include "../MeshLib/MeshConnectivity.h"
@@ -27,8 +28,43 @@ double ElasticShellMaterial::cotan_v0(const Eigen::Vector3d v0, const Eigen::Vec
     return cot;
 }
 
+void ElasticShellMaterial::stretchingEnergies(
+    const MeshConnectivity &mesh,
+    const Eigen::MatrixXd &curPos,
+    double lameAlpha, double lameBeta, double thickness,
+    const std::vector<Eigen::Matrix2d> &abars,
+    std::vector<double> &energies,
+    std::vector<Eigen::Matrix<double, 1, 9> > *derivs,
+    std::vector<Eigen::Matrix<double, 9, 9> > *hesses,
+    bool isLocalProj,
+    bool isParallel)
+{
+    int nfaces = mesh.nFaces();
+    energies.resize(nfaces);
+    if (derivs)
+        derivs->resize(nfaces);
+    if (hesses)
+        hesses->resize(nfaces);
 
+    if (isParallel)
+    {
+        auto computeStretching = [&](const tbb::blocked_range<uint32_t>& range)
+        {
 
+            for (uint32_t i = range.begin(); i < range.end(); ++i)
+            {
+                energies[i] = stretchingEnergy(mesh, curPos, lameAlpha, lameBeta, thickness, abars[i], i, derivs ? &(*derivs)[i] : NULL, hesses ? &(*hesses)[i] : NULL, isLocalProj);
+            }
 
-
-
+        };
+        tbb::blocked_range<uint32_t> rangex(0u, (uint32_t)nfaces);
+        tbb::parallel_for(rangex, computeStretching);
+    }
+    else
+    {
+        for (int i = 0; i < nfaces; i++)
+        {
+            energies[i] = stretchingEnergy(mesh, curPos, lameAlpha, lameBeta, thickness, abars[i], i, derivs ? &(*derivs)[i] : NULL, hesses ? &(*hesses)[i] : NULL, isLocalProj);
+        }
+    }
+}
@@ -26,6 +26,18 @@ public:
         Eigen::Matrix<double, 9, 9> *hessian,
         bool isLocalProj = false) = 0;
 
+    // stretching energies (and derivatives) of all the faces, computed face by face unless the material batches them
+    virtual void stretchingEnergies(
+        const MeshConnectivity &mesh,
+        const Eigen::MatrixXd &curPos,
+        double lameAlpha, double lameBeta, double thickness,
+        const std::vector<Eigen::Matrix2d> &abars,
+        std::vector<double> &energies,
+        std::vector<Eigen::Matrix<double, 1, 9> > *derivs,
+        std::vector<Eigen::Matrix<double, 9, 9> > *hesses,
+        bool isLocalProj = false,
+        bool isParallel = false);
+
     virtual double bendingEnergy(
         const MeshConnectivity &mesh,
         const Eigen::MatrixXd &curPos,
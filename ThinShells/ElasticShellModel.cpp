@@ -91,6 +91,7 @@ bool ElasticShellModel::initialization(const ElasticSetup setup, const ElasticSt
 	_lameBeta = setup.YoungsModulus / 2.0 / (1.0 + setup.PoissonsRatio);
 	_filePrefix = filePrefix;
 	_isUsePosHess = posHess;
+	_loadFactor = 1.0;
 	_isParallel = isParallel;
 
 	if (_isParallel)
@@ -105,6 +106,16 @@ bool ElasticShellModel::initialization(const ElasticSetup setup, const ElasticSt
 		return false;
 	}
 	setProjM();
+	if (_setup.pressure > 0)
+		_pressureCache.initialize(_state.mesh.faces(), _state.curPos.rows());
+
+	// one material for the whole run, the tension field material keeps the face regimes of its last evaluation
+	if (_setup.strecthingType == "NeoHookean")
+		_material = std::make_shared<NeoHookeanMaterial>();
+	else if (_setup.strecthingType == "tensionField")
+		_material = std::make_shared<StVKTensionFieldMaterial>();
+	else
+		_material = std::make_shared<StVKMaterial>();
 
 	std::cout << "material type: " << std::endl;
     std::cout << "stretching: " << setup.strecthingType << std::endl;
@@ -145,6 +156,56 @@ void ElasticShellModel::setProjM()
 		}
 	}
 	_proj = Projection(keepDOFs);
+
+	// selects the free vertex DOFs out of the 3 nverts position DOFs
+	std::vector<Eigen::Triplet<double> > T;
+	for (int i = 0; i < _proj.projDOFs(); i++)
+		if (_proj.fullDOF(i) < 3 * nverts)
+			T.push_back({ i, _proj.fullDOF(i), 1.0 });
+	_vertexDOFProj.resize(_proj.projDOFs(), 3 * nverts);
+	_vertexDOFProj.setFromTriplets(T.begin(), T.end());
+}
+
+Eigen::SparseMatrix<double> ElasticShellModel::pressureHessian()
+{
+	Eigen::SparseMatrix<double> H;
+	_pressureCache.hessian(_state.curPos, _loadFactor * _setup.pressure, H, _isParallel);
+	return _vertexDOFProj * H * _vertexDOFProj.transpose();
+}
+
+std::vector<int> ElasticShellModel::dofNodeMap()
+{
+	int nverts = _state.curPos.rows();
+	int nedgedofs = _setup.sff->numExtraDOFs();
+	std::vector<int> nodeIds(_proj.projDOFs());
+	for (int i = 0; i < nodeIds.size(); i++)
+	{
+		int fullId = _proj.fullDOF(i);
+		nodeIds[i] = fullId < 3 * nverts ? fullId / 3 : nverts + (fullId - 3 * nverts) / nedgedofs;
+	}
+	return nodeIds;
+}
+
+Eigen::MatrixXd ElasticShellModel::nearNullspace()
+{
+	int nverts = _state.curPos.rows();
+	Eigen::RowVector3d centroid = _state.curPos.colwise().mean();
+	Eigen::MatrixXd B = Eigen::MatrixXd::Zero(_proj.projDOFs(), 7);
+	for (int i = 0; i < B.rows(); i++)
+	{
+		int fullId = _proj.fullDOF(i);
+		if (fullId >= 3 * nverts)
+		{
+			B(i, 6) = 1;
+			continue;
+		}
+		int coord = fullId % 3;
+		Eigen::Vector3d pos = (_state.curPos.row(fullId / 3) - centroid).transpose();
+		B(i, coord) = 1;
+		for (int k = 0; k < 3; k++)
+			B(i, 3 + k) = Eigen::Vector3d::Unit(k).cross(pos)[coord];
+	}
+	return B;
 }
 
 void ElasticShellModel::convertCurState2Variables(const ElasticState curState, Eigen::VectorXd& x)
@@ -200,21 +261,9 @@ double ElasticShellModel::value(const Eigen::VectorXd& x)
 	convertVariables2CurState(x, _state); // add the clamped DOFs to the current state
 	double energy = 0;
 
-	std::shared_ptr<ElasticShellMaterial> mat;
+	std::shared_ptr<ElasticShellMaterial> mat = _material;
 
 	// stretching energy
-	if (_setup.strecthingType == "NeoHookean")
-	{
-		mat = std::make_shared<NeoHookeanMaterial>();
-	}
-	else if (_setup.strecthingType == "tensionField")
-	{
-		mat = std::make_shared<StVKTensionFieldMaterial>();	
-	}
-	else
-	{
-		mat = std::make_shared<StVKMaterial>();	
-	}
 	energy = elasticStretchingEnergy(_state.mesh, _state.curPos, _state.curEdgeDOFs, _lameAlpha, _lameBeta, _setup.thickness, _setup.abars, *_setup.sff, *mat, NULL, NULL, false, _isParallel);
 
 	// bending energy
@@ -261,7 +310,7 @@ double ElasticShellModel::value(const Eigen::VectorXd& x)
 	// pressure
 	if (_setup.pressure > 0)
 	{
-		double pressureE = pressureEnergy(_state.mesh.faces(), _state.curPos, _setup.pressure, NULL, NULL, Eigen::Vector3d::Zero(), false, _isParallel);
+		double pressureE = _pressureCache.energy(_state.curPos, _loadFactor * _setup.pressure, _isParallel);
 		energy += pressureE;
 	}
 
@@ -270,7 +319,7 @@ double ElasticShellModel::value(const Eigen::VectorXd& x)
 	for (int i = 0; i < nverts; i++)
 	{
 		Eigen::Vector3d pos = _state.curPos.row(i).transpose();
-		Eigen::Vector3d mg = _setup.vertArea[i] * _setup.thickness * _setup.density * _setup.gravity;
+		Eigen::Vector3d mg = _loadFactor * _setup.vertArea[i] * _setup.thickness * _setup.density * _setup.gravity;
 		gravityPotential += -mg.dot(pos);
 	}
 	energy += gravityPotential;
@@ -282,7 +331,7 @@ double ElasticShellModel::value(const Eigen::VectorXd& x)
 		int dofID = pair.first;
 		int nodeID = dofID / 3;
 		int coordID = dofID % 3;
-		double forceValue = pair.second;
+		double forceValue = _loadFactor * pair.second;
 		double coordValue = _state.curPos(nodeID, coordID);
 		pointForceE +=  -forceValue * coordValue;
 	}
@@ -305,21 +354,9 @@ double ElasticShellModel::stretchingValue(const Eigen::VectorXd& x)
 	convertVariables2CurState(x, _state);
 	double energy = 0;
 	// stretching energy
-	std::shared_ptr<ElasticShellMaterial> mat;
+	std::shared_ptr<ElasticShellMaterial> mat = _material;
 
     // stretching energy
-    if (_setup.strecthingType == "NeoHookean")
-    {
-        mat = std::make_shared<NeoHookeanMaterial>();
-    }
-    else if (_setup.strecthingType == "tensionField")
-    {
-        mat = std::make_shared<StVKTensionFieldMaterial>();
-    }
-    else
-    {
-        mat = std::make_shared<StVKMaterial>();
-    }
 	energy = elasticStretchingEnergy(_state.mesh, _state.curPos, _state.curEdgeDOFs, _lameAlpha, _lameBeta, _setup.thickness, _setup.abars, *_setup.sff, *mat, NULL, NULL, false, _isParallel);
 	
 	return energy;
@@ -329,21 +366,9 @@ double ElasticShellModel::bendingValue(const Eigen::VectorXd& x)
 {
 	double energy = 0;
 
-	std::shared_ptr<ElasticShellMaterial> mat;
+	std::shared_ptr<ElasticShellMaterial> mat = _material;
 
     // stretching energy
-    if (_setup.strecthingType == "NeoHookean")
-    {
-        mat = std::make_shared<NeoHookeanMaterial>();
-    }
-    else if (_setup.strecthingType == "tensionField")
-    {
-        mat = std::make_shared<StVKTensionFieldMaterial>();
-    }
-    else
-    {
-        mat = std::make_shared<StVKMaterial>();
-    }
 
 	// bending energy
 	double bendE = 0;
@@ -408,21 +433,9 @@ void ElasticShellModel::gradient(const Eigen::VectorXd& x, Eigen::VectorXd& grad
 	int nverts = _state.curPos.rows();
 	convertVariables2CurState(x, _state);
 	double energy = 0;
-	std::shared_ptr<ElasticShellMaterial> mat;
+	std::shared_ptr<ElasticShellMaterial> mat = _material;
 
     // stretching energy
-    if (_setup.strecthingType == "NeoHookean")
-    {
-        mat = std::make_shared<NeoHookeanMaterial>();
-    }
-    else if (_setup.strecthingType == "tensionField")
-    {
-        mat = std::make_shared<StVKTensionFieldMaterial>();
-    }
-    else
-    {
-        mat = std::make_shared<StVKMaterial>();
-    }
 	energy = elasticStretchingEnergy(_state.mesh, _state.curPos, _state.curEdgeDOFs, _lameAlpha, _lameBeta, _setup.thickness, _setup.abars, *_setup.sff, *mat, &grad, NULL, false, _isParallel);
 
 	// bending energy
@@ -471,7 +484,8 @@ void ElasticShellModel::gradient(const Eigen::VectorXd& x, Eigen::VectorXd& grad
 	if (_setup.pressure > 0)
 	{
 		Eigen::VectorXd pressuredE;
-		double pressureE = pressureEnergy(_state.mesh.faces(), _state.curPos, _setup.pressure, &pressuredE, NULL, Eigen::Vector3d::Zero(), false, _isParallel);
+		double pressureE = _pressureCache.energy(_state.curPos, _loadFactor * _setup.pressure, _isParallel);
+		_pressureCache.gradient(_state.curPos, _loadFactor * _setup.pressure, pressuredE, _isParallel);
 		energy += pressureE;
 
 		grad.segment(0, 3 * nverts) += pressuredE;
@@ -483,7 +497,7 @@ void ElasticShellModel::gradient(const Eigen::VectorXd& x, Eigen::VectorXd& grad
 	for (int i = 0; i < nverts; i++)
 	{
 		Eigen::Vector3d pos = _state.curPos.row(i).transpose();
-		Eigen::Vector3d mg = _setup.vertArea[i] * _setup.thickness * _setup.density * _setup.gravity;
+		Eigen::Vector3d mg = _loadFactor * _setup.vertArea[i] * _setup.thickness * _setup.density * _setup.gravity;
 		gravityPotential += -mg.dot(pos);
 
 		grad.segment<3>(3 * i) += -mg;
@@ -497,7 +511,7 @@ void ElasticShellModel::gradient(const Eigen::VectorXd& x, Eigen::VectorXd& grad
 		int dofID = pair.first;
 		int nodeID = dofID / 3;
 		int coordID = dofID % 3;
-		double forceValue = pair.second;
+		double forceValue = _loadFactor * pair.second;
 		pointForceE +=   -forceValue * _state.curPos(nodeID, coordID);
 		grad(dofID) +=   -forceValue;
 	}
@@ -528,21 +542,9 @@ Eigen::VectorXd ElasticShellModel::membraneGrad(const Eigen::VectorXd& x)
 	double energy = 0;
 	Eigen::VectorXd grad;
 	grad = Eigen::VectorXd::Zero(dofs);
-	std::shared_ptr<ElasticShellMaterial> mat;
+	std::shared_ptr<ElasticShellMaterial> mat = _material;
 
     // stretching energy
-    if (_setup.strecthingType == "NeoHookean")
-    {
-        mat = std::make_shared<NeoHookeanMaterial>();
-    }
-    else if (_setup.strecthingType == "tensionField")
-    {
-        mat = std::make_shared<StVKTensionFieldMaterial>();
-    }
-    else
-    {
-        mat = std::make_shared<StVKMaterial>();
-    }
 	energy = elasticStretchingEnergy(_state.mesh, _state.curPos, _state.curEdgeDOFs, _lameAlpha, _lameBeta, _setup.thickness, _setup.abars, *_setup.sff, *mat, &grad, NULL, false, _isParallel);
 	
 	Eigen::VectorXd projgrad;
@@ -564,21 +566,9 @@ Eigen::VectorXd ElasticShellModel::bendingGrad(const Eigen::VectorXd& x)
 	double energy = 0;
 	Eigen::VectorXd grad;
 	grad = Eigen::VectorXd::Zero(dofs);
-	std::shared_ptr<ElasticShellMaterial> mat;
+	std::shared_ptr<ElasticShellMaterial> mat = _material;
 
     // stretching energy
-    if (_setup.strecthingType == "NeoHookean")
-    {
-        mat = std::make_shared<NeoHookeanMaterial>();
-    }
-    else if (_setup.strecthingType == "tensionField")
-    {
-        mat = std::make_shared<StVKTensionFieldMaterial>();
-    }
-    else
-    {
-        mat = std::make_shared<StVKMaterial>();
-    }
 
 	// bending energy
 	Eigen::VectorXd gradB;
@@ -644,7 +634,7 @@ void ElasticShellModel::externalForces(const Eigen::VectorXd& x, Eigen::VectorXd
 	if (_setup.pressure > 0)
 	{
 		Eigen::VectorXd pressuredE;
-		double pressureE = pressureEnergy(_state.mesh.faces(), _state.curPos, _setup.pressure, &pressuredE, NULL, Eigen::Vector3d::Zero(), false, _isParallel);
+		_pressureCache.gradient(_state.curPos, _loadFactor * _setup.pressure, pressuredE, _isParallel);
 		grad.segment(0, 3 * nverts) += pressuredE;
 	}
 
@@ -652,7 +642,7 @@ void ElasticShellModel::externalForces(const Eigen::VectorXd& x, Eigen::VectorXd
 	for (int i = 0; i < nverts; i++)
 	{
 		Eigen::Vector3d pos = _state.curPos.row(i).transpose();
-		Eigen::Vector3d mg = _setup.vertArea[i] * _setup.thickness * _setup.density * _setup.gravity;
+		Eigen::Vector3d mg = _loadFactor * _setup.vertArea[i] * _setup.thickness * _setup.density * _setup.gravity;
 		grad.segment<3>(3 * i) += -mg;
 	}
 	
@@ -662,7 +652,7 @@ void ElasticShellModel::externalForces(const Eigen::VectorXd& x, Eigen::VectorXd
 		int dofID = pair.first;
 		int nodeID = dofID / 3;
 		int coordID = dofID % 3;
-		double forceValue = pair.second;
+		double forceValue = _loadFactor * pair.second;
 		grad(dofID) +=   -forceValue;
 	}
 
@@ -695,7 +685,7 @@ Eigen::VectorXd ElasticShellModel::externalForces(const Eigen::VectorXd& x)
 	if (_setup.pressure > 0)
 	{
 		Eigen::VectorXd pressuredE;
-		double pressureE = pressureEnergy(_state.mesh.faces(), _state.curPos, _setup.pressure, &pressuredE, NULL, Eigen::Vector3d::Zero(), false, _isParallel);
+		_pressureCache.gradient(_state.curPos, _loadFactor * _setup.pressure, pressuredE, _isParallel);
 		grad.segment(0, 3 * nverts) += pressuredE;
 	}
 
@@ -703,7 +693,7 @@ Eigen::VectorXd ElasticShellModel::externalForces(const Eigen::VectorXd& x)
 	for (int i = 0; i < nverts; i++)
 	{
 		Eigen::Vector3d pos = _state.curPos.row(i).transpose();
-		Eigen::Vector3d mg = _setup.vertArea[i] * _setup.thickness * _setup.density * _setup.gravity;
+		Eigen::Vector3d mg = _loadFactor * _setup.vertArea[i] * _setup.thickness * _setup.density * _setup.gravity;
 		grad.segment<3>(3 * i) += -mg;
 	}
 	
@@ -713,7 +703,7 @@ Eigen::VectorXd ElasticShellModel::externalForces(const Eigen::VectorXd& x)
 		int dofID = pair.first;
 		int nodeID = dofID / 3;
 		int coordID = dofID % 3;
-		double forceValue = pair.second;
+		double forceValue = _loadFactor * pair.second;
 		grad(dofID) +=   -forceValue;
 	}
 
@@ -739,25 +729,12 @@ void ElasticShellModel::hessian(const Eigen::VectorXd& x, Eigen::SparseMatrix<do
 
 	convertVariables2CurState(x, _state);
 	double energy = 0;
-	std::shared_ptr<ElasticShellMaterial> mat;
+	std::shared_ptr<ElasticShellMaterial> mat = _material;
 
 	int nverts = _state.curPos.rows();
 	int nedges = _state.mesh.nEdges();
 	int nedgedofs = _setup.sff->numExtraDOFs();
 
-    if (_setup.strecthingType == "NeoHookean")
-    {
-        mat = std::make_shared<NeoHookeanMaterial>();
-    }
-
-    else if (_setup.strecthingType == "tensionField")
-    {
-        mat = std::make_shared<StVKTensionFieldMaterial>();
-    }
-    else
-    {
-        mat = std::make_shared<StVKMaterial>();
-    }
 
 	// stretching energy
 	timer.start();
@@ -819,19 +796,14 @@ void ElasticShellModel::hessian(const Eigen::VectorXd& x, Eigen::SparseMatrix<do
 	timer.start();
 
 	// pressure
+	Eigen::SparseMatrix<double> pressureH;
 	if (_setup.pressure > 0)
 	{
-		std::vector<Eigen::Triplet<double> > pressureHcoeffs;
-		double pressureE = pressureEnergy(_state.mesh.faces(), _state.curPos, _setup.pressure, NULL, &pressureHcoeffs, Eigen::Vector3d::Zero(), false, _isParallel); // never use local PD-projection for pressure, since it is always indefinite.
+		// gathered in parallel into the cached pattern, added after the triplets (never PD-projected, it is always indefinite)
+		energy += _pressureCache.energy(_state.curPos, _loadFactor * _setup.pressure, _isParallel);
+		pressureH = pressureHessian();
  		timer.stop();
 		std::cout << "pressure hessian took: " << timer.elapsedSeconds() << std::endl;
-
-		timer.start();
-		energy += pressureE;
-		hessianT.insert(hessianT.end(), pressureHcoeffs.begin(), pressureHcoeffs.end());
-		timer.stop();
-
-		std::cout << "appending pressure hessian took: " << timer.elapsedSeconds() << std::endl;
 		timer.start();
 	}
 	
@@ -841,7 +813,7 @@ void ElasticShellModel::hessian(const Eigen::VectorXd& x, Eigen::SparseMatrix<do
 	for (int i = 0; i < nverts; i++)
 	{
 		Eigen::Vector3d pos = _state.curPos.row(i).transpose();
-		Eigen::Vector3d mg = _setup.vertArea[i] * _setup.thickness * _setup.density * _setup.gravity;
+		Eigen::Vector3d mg = _loadFactor * _setup.vertArea[i] * _setup.thickness * _setup.density * _setup.gravity;
 		gravityPotential += -mg.dot(pos);
 	}
 	energy += gravityPotential;
@@ -856,7 +828,7 @@ void ElasticShellModel::hessian(const Eigen::VectorXd& x, Eigen::SparseMatrix<do
 		int dofID = pair.first;
 		int nodeID = dofID / 3;
 		int coordID = dofID % 3;
-		double forceValue = pair.second;
+		double forceValue = _loadFactor * pair.second;
 		pointForceE +=   -forceValue * _state.curPos(nodeID, coordID);
 	}
 	energy += pointForceE;
@@ -884,6 +856,8 @@ void ElasticShellModel::hessian(const Eigen::VectorXd& x, Eigen::SparseMatrix<do
 	timer.start();
 	hessian.resize(_proj.projDOFs(), _proj.projDOFs());
 	hessian.setFromTriplets(hessianT.begin(), hessianT.end());
+	if (pressureH.rows() > 0)
+		hessian += pressureH;
 	timer.stop();
 	std::cout << "setting hessian from triplet took: " << timer.elapsedSeconds() << std::endl;	
 }
@@ -896,25 +870,12 @@ Eigen::SparseMatrix<double> ElasticShellModel::membraneHessian(const Eigen::Vect
 
 	convertVariables2CurState(x, _state);
 	double energy = 0;
-	std::shared_ptr<ElasticShellMaterial> mat;
+	std::shared_ptr<ElasticShellMaterial> mat = _material;
 
 	int nverts = _state.curPos.rows();
 	int nedges = _state.mesh.nEdges();
 	int nedgedofs = _setup.sff->numExtraDOFs();
 
-    if (_setup.strecthingType == "NeoHookean")
-    {
-        mat = std::make_shared<NeoHookeanMaterial>();
-    }
-
-    else if (_setup.strecthingType == "tensionField")
-    {
-        mat = std::make_shared<StVKTensionFieldMaterial>();
-    }
-    else
-    {
-        mat = std::make_shared<StVKMaterial>();
-    }
 
 	// stretching energy
 	timer.start();
@@ -945,25 +906,12 @@ Eigen::SparseMatrix<double> ElasticShellModel::bendingHessian(const Eigen::Vecto
 
 	convertVariables2CurState(x, _state);
 	double energy = 0;
-	std::shared_ptr<ElasticShellMaterial> mat;
+	std::shared_ptr<ElasticShellMaterial> mat = _material;
 
 	int nverts = _state.curPos.rows();
 	int nedges = _state.mesh.nEdges();
 	int nedgedofs = _setup.sff->numExtraDOFs();
 
-    if (_setup.strecthingType == "NeoHookean")
-    {
-        mat = std::make_shared<NeoHookeanMaterial>();
-    }
-
-    else if (_setup.strecthingType == "tensionField")
-    {
-        mat = std::make_shared<StVKTensionFieldMaterial>();
-    }
-    else
-    {
-        mat = std::make_shared<StVKMaterial>();
-    }
 
 	// bending energy
 	timer.start();
@@ -1046,19 +994,14 @@ Eigen::SparseMatrix<double> ElasticShellModel::exterHessian(const Eigen::VectorX
 	int nedgedofs = _setup.sff->numExtraDOFs();
 
 	// pressure
+	Eigen::SparseMatrix<double> pressureH;
 	if (_setup.pressure > 0)
 	{
-		std::vector<Eigen::Triplet<double> > pressureHcoeffs;
-		double pressureE = pressureEnergy(_state.mesh.faces(), _state.curPos, _setup.pressure, NULL, &pressureHcoeffs, Eigen::Vector3d::Zero(), false, _isParallel); // never use local PD-projection for pressure, since it is always indefinite.
+		// gathered in parallel into the cached pattern, added after the triplets (never PD-projected, it is always indefinite)
+		energy += _pressureCache.energy(_state.curPos, _loadFactor * _setup.pressure, _isParallel);
+		pressureH = pressureHessian();
  		timer.stop();
 		std::cout << "pressure hessian took: " << timer.elapsedSeconds() << std::endl;
-
-		timer.start();
-		energy += pressureE;
-		hessianT.insert(hessianT.end(), pressureHcoeffs.begin(), pressureHcoeffs.end());
-		timer.stop();
-
-		std::cout << "appending pressure hessian took: " << timer.elapsedSeconds() << std::endl;
 		timer.start();
 	}
 	
@@ -1068,7 +1011,7 @@ Eigen::SparseMatrix<double> ElasticShellModel::exterHessian(const Eigen::VectorX
 	for (int i = 0; i < nverts; i++)
 	{
 		Eigen::Vector3d pos = _state.curPos.row(i).transpose();
-		Eigen::Vector3d mg = _setup.vertArea[i] * _setup.thickness * _setup.density * _setup.gravity;
+		Eigen::Vector3d mg = _loadFactor * _setup.vertArea[i] * _setup.thickness * _setup.density * _setup.gravity;
 		gravityPotential += -mg.dot(pos);
 	}
 	energy += gravityPotential;
@@ -1083,7 +1026,7 @@ Eigen::SparseMatrix<double> ElasticShellModel::exterHessian(const Eigen::VectorX
 		int dofID = pair.first;
 		int nodeID = dofID / 3;
 		int coordID = dofID % 3;
-		double forceValue = pair.second;
+		double forceValue = _loadFactor * pair.second;
 		pointForceE +=   -forceValue * _state.curPos(nodeID, coordID);
 	}
 	energy += pointForceE;
@@ -1111,12 +1054,33 @@ Eigen::SparseMatrix<double> ElasticShellModel::exterHessian(const Eigen::VectorX
 	timer.start();
 	hessian.resize(_proj.projDOFs(), _proj.projDOFs());
 	hessian.setFromTriplets(hessianT.begin(), hessianT.end());
+	if (pressureH.rows() > 0)
+		hessian += pressureH;
 	timer.stop();
 	std::cout << "setting external force hessian from triplet took: " << timer.elapsedSeconds() << std::endl;	
 
 	return hessian;
 }
 
+int ElasticShellModel::updateTensionFieldRegimes()
+{
+	StVKTensionFieldMaterial* mat = dynamic_cast<StVKTensionFieldMaterial*>(_material.get());
+	if (!mat)
+		return 0;
+	const std::vector<int>& regimes = mat->faceRegimes;
+
+	int nchanged = 0;
+	if (_tensionFieldRegimes.size() != regimes.size())
+		nchanged = regimes.size();
+	else
+	{
+		for (int i = 0; i < regimes.size(); i++)
+			nchanged += (regimes[i] != _tensionFieldRegimes[i]);
+	}
+	_tensionFieldRegimes = regimes;
+	return nchanged;
+}
+
 double ElasticShellModel::getMaxStep(const Eigen::VectorXd& x, const Eigen::VectorXd& dir, double step)
 {
 	if (_setup.penaltyK > 0)
@@ -1205,7 +1169,39 @@ double ElasticShellModel::getMaxStep(const Eigen::VectorXd& x, const Eigen::Vect
 
 Eigen::SparseMatrix<double> ElasticShellModel::buildLinearConstraints()
 {
-	Eigen::SparseMatrix<double> A;
+	int nverts = _state.curPos.rows();
+	int nedges = _state.mesh.nEdges();
+	int nedgedofs = _setup.sff->numExtraDOFs();
+	int fullDOFs = 3 * nverts + nedgedofs * nedges;
+
+	std::vector<int> projIds(fullDOFs, -1);
+	for (int i = 0; i < _proj.projDOFs(); i++)
+		projIds[_proj.fullDOF(i)] = i;
+
+	// the clamped DOFs do not move, their terms drop out
+	std::vector<Eigen::Triplet<double> > T;
+	int nrows = 0;
+	for (auto& row : _setup.linearConstraints)
+	{
+		bool isEmpty = true;
+		for (auto& it : row)
+		{
+			if (it.first >= fullDOFs)
+			{
+				std::cout << "linear constraint on DOF " << it.first << " out of range, " << fullDOFs << " DOFs in total." << std::endl;
+				continue;
+			}
+			if (projIds[it.first] != -1 && it.second != 0)
+			{
+				T.push_back({ nrows, projIds[it.first], it.second });
+				isEmpty = false;
+			}
+		}
+		if (!isEmpty)
+			nrows++;
+	}
+	Eigen::SparseMatrix<double> A(nrows, _proj.projDOFs());
+	A.setFromTriplets(T.begin(), T.end());
 	return A;
 }
 
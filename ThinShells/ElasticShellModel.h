@@ -4,8 +4,10 @@
 #include <Eigen/Sparse>
 #include "ElasticSetup.h"
 #include "ElasticState.h"
+#include "ElasticShellMaterial.h"
 #include "../SecondFundamentalForm/SecondFundamentalFormDiscretization.h"
 #include "../Common/CommonFunctions.h"
+#include "../ExternalEnergies/PressureEnergy.h"
 
 class Projection
 {
@@ -17,6 +19,7 @@ public:
     void projectVector(const Eigen::VectorXd& fullVec, Eigen::VectorXd& projVec) const;
     void unprojectVector(const Eigen::VectorXd& projVec, Eigen::VectorXd& fullVec) const;
     void projectMatrix(std::vector<Eigen::Triplet<double> >& mat) const;
+    int fullDOF(int projDOF) const { return invdofmap[projDOF]; }
 
 private:
     std::vector<int> dofmap;
@@ -50,6 +53,15 @@ public:
     Eigen::SparseMatrix<double> membraneHessian(const Eigen::VectorXd& x);
     Eigen::SparseMatrix<double> exterHessian(const Eigen::VectorXd& x);
 
+    // tension field regimes (slack / wrinkled / pure tension) per face published by the last stretching evaluation, returns the
+    // number of faces that switched regime since the last call
+    int updateTensionFieldRegimes();
+
+    // node of every free DOF: vertex i for the position DOFs, nverts + e for the DOFs of edge e (used to group the DOFs into blocks)
+    std::vector<int> dofNodeMap();
+    // near-nullspace of the free DOFs for AMG: 3 translations and 3 rotations of curPos, plus a constant mode on the edge DOFs
+    Eigen::MatrixXd nearNullspace();
+
     //max step before touching the obstacles
     double getMaxStep(const Eigen::VectorXd& x, const Eigen::VectorXd& dir, double step);
     void testMaxStep();
@@ -63,6 +75,7 @@ public:
         return ret;
     }
 
+    // setup.linearConstraints on the free DOFs, A du = 0 for the displacements du
     Eigen::SparseMatrix<double> buildLinearConstraints();
 
     void testValueAndGradient(const Eigen::VectorXd& x);
@@ -91,4 +104,13 @@ public:
     bool _isC2;
     bool _isUsePosHess;
     bool _isParallel;
+    double _loadFactor;     // scales the pressure, gravity and point forces (load continuation), 1 by default
+    std::vector<int> _tensionFieldRegimes;
+    std::shared_ptr<ElasticShellMaterial> _material;	// stretching (and midedge bending) material
+    PressureEnergyCache _pressureCache;
+
+private:
+    // pressure hessian from the cached pattern, restricted to the free DOFs (curPos is the current state)
+    Eigen::SparseMatrix<double> pressureHessian();
+    Eigen::SparseMatrix<double> _vertexDOFProj;
 };
@@ -1,125 +1,128 @@
+#include <algorithm>
+#include <tbb/tbb.h>
 #include "StVKTensionFieldMaterial.h"
 #include "../Common/CommonFunctions.h"
+#include "../MeshLib/MeshConnectivity.h"
 
-double StVKTensionFieldMaterial::stretchingEnergy(
-    const MeshConnectivity &mesh,
-    const Eigen::MatrixXd &curPos,    
-    double lameAlpha, double lameBeta, double thickness,
-    const Eigen::Matrix2d &abar,
-    int face,
-    Eigen::Matrix<double, 1, 9> *derivative, // F(face, i)
-    Eigen::Matrix<double, 9, 9> *hessian,
-    bool isLocalProj)
+static int tensionFieldRegime(const Eigen::Matrix2d& a, const Eigen::Matrix2d& abar, double kstretch1, double kstretch2)
+{
+    Eigen::Matrix2d abarinv = abar.inverse();
+    Eigen::Matrix2d strain = abarinv * (a - abar);
+    double T = strain.trace();
+    double D = (a - abar).determinant() * abarinv.determinant();
+
+    double lambda1 = T / 2.0 + sqrt(std::max(0.0, T * T / 4.0 - D));
+    double lambda2 = T / 2.0 - sqrt(std::max(0.0, T * T / 4.0 - D));
+    if (lambda2 > lambda1)
+        std::swap(lambda1, lambda2);
+
+    double transitionCoeff = -kstretch1 / (kstretch1 + kstretch2);
+
+    if (lambda1 >= 0 && lambda2 >= transitionCoeff * lambda1)
+        return pureTensionRegime;
+    if (lambda1 < 0)
+        return slackRegime;
+    return wrinkledRegime;
+}
+
+// biaxial tension: plain StVK energy of the strain abarinv * (a - abar)
+static double pureTensionKernel(
+    const Eigen::Matrix2d& a, const Eigen::Matrix2d& abar,
+    const Eigen::Matrix<double, 4, 9>& aderiv, const std::vector<Eigen::Matrix<double, 9, 9> >& ahess,
+    double kstretch1, double kstretch2,
+    Eigen::Matrix<double, 1, 9>* derivative,
+    Eigen::Matrix<double, 9, 9>* hessian)
 {
     double dA = sqrt(abar.determinant());
     Eigen::Matrix2d abarinv = abar.inverse();
-    Eigen::Matrix<double, 4, 9> aderiv;
-    std::vector<Eigen::Matrix<double, 9, 9> > ahess;
-    Eigen::Matrix2d a = firstFundamentalForm(mesh, curPos, face, (derivative || hessian) ? &aderiv : NULL, hessian ? &ahess : NULL);
+    Eigen::Matrix2d strain = abarinv * (a - abar);
+    double result = 0;
 
-    double kstretch1 = thickness / 8.0 * lameAlpha;
-    double kstretch2 = thickness / 4.0 * lameBeta;
-   
-    if (derivative)
+    double traceE = strain.trace();
+
+    // square of trace
+    result += kstretch1 * 0.5 * dA * traceE * traceE;
+
+    if (derivative || hessian)
     {
-        derivative->setZero();
+        Eigen::Matrix<double, 1, 9> tr_dstrain;
+        tr_dstrain = abarinv(0, 0) * aderiv.row(0) + abarinv(0, 1) * aderiv.row(2);
+        tr_dstrain += abarinv(1, 0) * aderiv.row(1) + abarinv(1, 1) * aderiv.row(3);
+
+        if (derivative)
+        {
+            (*derivative) += kstretch1 * dA * traceE * tr_dstrain;
+        }
+        if (hessian)
+        {
+            (*hessian) += kstretch1 * dA * traceE * (abarinv(0,0) * ahess[0] + abarinv(0,1) * ahess[2]);
+            (*hessian) += kstretch1 * dA * traceE * (abarinv(1,1) * ahess[3] + abarinv(1,0) * ahess[1]);
+            (*hessian) += kstretch1 * dA * tr_dstrain.transpose() * tr_dstrain;
+        }
     }
-    if (hessian)    // Note that: tension field stretching hessian is always SPD.
+
+    // trace of strain tensor square
+    result += kstretch2 * 0.5 * dA * (strain*strain).trace();
+
+    if (derivative || hessian)
     {
-        hessian->setZero();
+        Eigen::Matrix2d mat = abarinv * strain.transpose();
+        if (derivative)
+        {
+            (*derivative) += kstretch2 * dA * mat(0, 0) * aderiv.row(0);
+            (*derivative) += kstretch2 * dA * mat(0, 1) * aderiv.row(1);
+            (*derivative) += kstretch2 * dA * mat(1, 0) * aderiv.row(2);
+            (*derivative) += kstretch2 * dA * mat(1, 1) * aderiv.row(3);
+        }
+        if (hessian)
+        {
+            (*hessian) += kstretch2 * dA * mat(0, 0) * ahess[0];
+            (*hessian) += kstretch2 * dA * mat(0, 1) * ahess[1];
+            (*hessian) += kstretch2 * dA * mat(1, 0) * ahess[2];
+            (*hessian) += kstretch2 * dA * mat(1, 1) * ahess[3];
+
+            Eigen::Matrix<double, 4, 9> fac;
+            fac.row(0) = abarinv(0, 0) * aderiv.row(0) + abarinv(0, 1) * aderiv.row(2);
+            fac.row(1) = abarinv(0, 0) * aderiv.row(1) + abarinv(0, 1) * aderiv.row(3);
+            fac.row(2) = abarinv(1, 0) * aderiv.row(0) + abarinv(1, 1) * aderiv.row(2);
+            fac.row(3) = abarinv(1, 0) * aderiv.row(1) + abarinv(1, 1) * aderiv.row(3);
+            (*hessian) += kstretch2 * dA * fac.row(0).transpose()* fac.row(0);
+            (*hessian) += kstretch2 * dA * fac.row(1).transpose()* fac.row(2);
+            (*hessian) += kstretch2 * dA * fac.row(2).transpose()* fac.row(1);
+            (*hessian) += kstretch2 * dA * fac.row(3).transpose()* fac.row(3);
+        }
     }
 
-    Eigen::Matrix2d strain = abarinv*(a - abar);
+    return result;
+}
+
+// uniaxial tension: only the largest principal strain lambda1 is penalized, with the relaxed stiffness
+static double wrinkledKernel(
+    const Eigen::Matrix2d& a, const Eigen::Matrix2d& abar,
+    const Eigen::Matrix<double, 4, 9>& aderiv, const std::vector<Eigen::Matrix<double, 9, 9> >& ahess,
+    double kstretch1, double kstretch2,
+    Eigen::Matrix<double, 1, 9>* derivative,
+    Eigen::Matrix<double, 9, 9>* hessian)
+{
+    double dA = sqrt(abar.determinant());
+    Eigen::Matrix2d abarinv = abar.inverse();
+    Eigen::Matrix2d strain = abarinv * (a - abar);
     double T = strain.trace();
-    double adiffdet = (a - abar).determinant();
     double detAbarinv = abarinv.determinant();
-    double D = adiffdet * detAbarinv;
+    double D = (a - abar).determinant() * detAbarinv;
 
-    double result = 0;
     double lambda1 = T / 2.0 + sqrt(std::max(0.0, T*T / 4.0 - D));
     double lambda2 = T / 2.0 - sqrt(std::max(0.0, T*T / 4.0 - D));
     double sign = 1.0;
-    
+
     //make lambda1 the largerest eigen value
     if (lambda2 > lambda1)
     {
-        std::swap(lambda1, lambda2); 
+        std::swap(lambda1, lambda2);
         sign = -1.0;
     }
 
-    bool puretension = false;    
-    
-    double transitionCoeff = - kstretch1 / (kstretch1 + kstretch2);
-
-    if (lambda1 >= 0 && lambda2 >= transitionCoeff * lambda1)
-    {
-        puretension = true;    
-    }
-    
-    if (puretension)
-    {
-        double traceE = strain.trace();
-
-        // square of trace
-        result += kstretch1 * 0.5 * dA * traceE * traceE;
-
-        if (derivative || hessian)
-        {
-            Eigen::Matrix<double, 1, 9> tr_dstrain;
-            tr_dstrain = abarinv(0, 0) * aderiv.row(0) + abarinv(0, 1) * aderiv.row(2);
-            tr_dstrain += abarinv(1, 0) * aderiv.row(1) + abarinv(1, 1) * aderiv.row(3);
-            
-            if (derivative)
-            {
-                
-                (*derivative) += kstretch1 * dA * traceE * tr_dstrain;  
-            }
-            if (hessian)
-            {
-                (*hessian) += kstretch1 * dA * traceE * (abarinv(0,0) * ahess[0] + abarinv(0,1) * ahess[2]);
-                (*hessian) += kstretch1 * dA * traceE * (abarinv(1,1) * ahess[3] + abarinv(1,0) * ahess[1]);
-                (*hessian) += kstretch1 * dA * tr_dstrain.transpose() * tr_dstrain;
-            }
-        }
-
-        // trace of strain tensor square
-        result += kstretch2 * 0.5 * dA * (strain*strain).trace();
-
-        if (derivative || hessian)
-        {
-            Eigen::Matrix2d mat = abarinv * strain.transpose();
-            if (derivative)
-            {
-                (*derivative) += kstretch2 * dA * mat(0, 0) * aderiv.row(0);
-                (*derivative) += kstretch2 * dA * mat(0, 1) * aderiv.row(1); 
-                (*derivative) += kstretch2 * dA * mat(1, 0) * aderiv.row(2); 
-                (*derivative) += kstretch2 * dA * mat(1, 1) * aderiv.row(3);
-            }
-            if (hessian)
-            {
-                (*hessian) += kstretch2 * dA * mat(0, 0) * ahess[0];
-                (*hessian) += kstretch2 * dA * mat(0, 1) * ahess[1];
-                (*hessian) += kstretch2 * dA * mat(1, 0) * ahess[2];
-                (*hessian) += kstretch2 * dA * mat(1, 1) * ahess[3];
-
-                Eigen::Matrix<double, 4, 9> fac;
-                fac.row(0) = abarinv(0, 0) * aderiv.row(0) + abarinv(0, 1) * aderiv.row(2);
-                fac.row(1) = abarinv(0, 0) * aderiv.row(1) + abarinv(0, 1) * aderiv.row(3);
-                fac.row(2) = abarinv(1, 0) * aderiv.row(0) + abarinv(1, 1) * aderiv.row(2);
-                fac.row(3) = abarinv(1, 0) * aderiv.row(1) + abarinv(1, 1) * aderiv.row(3);
-                (*hessian) += kstretch2 * dA * fac.row(0).transpose()* fac.row(0);
-                (*hessian) += kstretch2 * dA * fac.row(1).transpose()* fac.row(2);
-                (*hessian) += kstretch2 * dA * fac.row(2).transpose()* fac.row(1);
-                (*hessian) += kstretch2 * dA * fac.row(3).transpose()* fac.row(3);
-            }
-        }
-
-        return result;
-    }
-
-    if (lambda1 < 0)
-        return result;
-
+    double result = 0;
     double lambda = lambda1;
     double kstretching = kstretch1 + kstretch2 - kstretch1 * kstretch1 / (kstretch1 + kstretch2);
 
@@ -188,6 +191,210 @@ double StVKTensionFieldMaterial::stretchingEnergy(
     return result;
 }
 
+double StVKTensionFieldMaterial::stretchingEnergy(
+    const MeshConnectivity &mesh,
+    const Eigen::MatrixXd &curPos,    
+    double lameAlpha, double lameBeta, double thickness,
+    const Eigen::Matrix2d &abar,
+    int face,
+    Eigen::Matrix<double, 1, 9> *derivative, // F(face, i)
+    Eigen::Matrix<double, 9, 9> *hessian,
+    bool isLocalProj)
+{
+    Eigen::Matrix<double, 4, 9> aderiv;
+    std::vector<Eigen::Matrix<double, 9, 9> > ahess;
+    Eigen::Matrix2d a = firstFundamentalForm(mesh, curPos, face, (derivative || hessian) ? &aderiv : NULL, hessian ? &ahess : NULL);
+
+    double kstretch1 = thickness / 8.0 * lameAlpha;
+    double kstretch2 = thickness / 4.0 * lameBeta;
+   
+    if (derivative)
+    {
+        derivative->setZero();
+    }
+    if (hessian)    // Note that: tension field stretching hessian is always SPD.
+    {
+        hessian->setZero();
+    }
+
+    int regime = tensionFieldRegime(a, abar, kstretch1, kstretch2);
+    if (regime == pureTensionRegime)
+        return pureTensionKernel(a, abar, aderiv, ahess, kstretch1, kstretch2, derivative, hessian);
+    else if (regime == wrinkledRegime)
+        return wrinkledKernel(a, abar, aderiv, ahess, kstretch1, kstretch2, derivative, hessian);
+    return 0;
+}
+
+void StVKTensionFieldMaterial::classifyFaces(
+    const MeshConnectivity& mesh,
+    const Eigen::MatrixXd& curPos,
+    double lameAlpha, double lameBeta, double thickness,
+    const std::vector<Eigen::Matrix2d>& abars,
+    std::vector<int>& regimes,
+    bool isParallel)
+{
+    int nfaces = mesh.nFaces();
+    double kstretch1 = thickness / 8.0 * lameAlpha;
+    double kstretch2 = thickness / 4.0 * lameBeta;
+
+    regimes.resize(nfaces);
+    _faceMetrics.resize(nfaces);
+
+    auto classify = [&](const tbb::blocked_range<uint32_t>& range)
+    {
+        for (uint32_t i = range.begin(); i < range.end(); ++i)
+        {
+            _faceMetrics[i] = firstFundamentalForm(mesh, curPos, i, NULL, NULL);
+            regimes[i] = tensionFieldRegime(_faceMetrics[i], abars[i], kstretch1, kstretch2);
+        }
+    };
+
+    tbb::blocked_range<uint32_t> rangex(0u, (uint32_t)nfaces);
+    if (isParallel)
+        tbb::parallel_for(rangex, classify);
+    else
+        classify(rangex);
+}
+
+// derivative of the first fundamental form only, the metric itself is already known from the classification
+static void firstFundamentalFormDerivative(const MeshConnectivity& mesh, const Eigen::MatrixXd& curPos, int face, Eigen::Matrix<double, 4, 9>& aderiv)
+{
+    Eigen::Vector3d q0 = curPos.row(mesh.faceVertex(face, 0));
+    Eigen::Vector3d e1 = curPos.row(mesh.faceVertex(face, 1)).transpose() - q0;
+    Eigen::Vector3d e2 = curPos.row(mesh.faceVertex(face, 2)).transpose() - q0;
+
+    aderiv.row(0) << -2.0 * e1.transpose(), 2.0 * e1.transpose(), Eigen::RowVector3d::Zero();
+    aderiv.row(1) << -(e1 + e2).transpose(), e2.transpose(), e1.transpose();
+    aderiv.row(2) = aderiv.row(1);
+    aderiv.row(3) << -2.0 * e2.transpose(), Eigen::RowVector3d::Zero(), 2.0 * e2.transpose();
+}
+
+// runs kernel(begin, end) over [0, n), the kernel is a template argument so that it is inlined into the loop
+template <typename Kernel>
+static void forRange(int n, bool isParallel, const Kernel& kernel)
+{
+    if (n == 0)
+        return;
+    if (isParallel)
+        tbb::parallel_for(tbb::blocked_range<int>(0, n), [&](const tbb::blocked_range<int>& range) { kernel(range.begin(), range.end()); });
+    else
+        kernel(0, n);
+}
+
+void StVKTensionFieldMaterial::stretchingEnergies(
+    const MeshConnectivity& mesh,
+    const Eigen::MatrixXd& curPos,
+    double lameAlpha, double lameBeta, double thickness,
+    const std::vector<Eigen::Matrix2d>& abars,
+    std::vector<double>& energies,
+    std::vector<Eigen::Matrix<double, 1, 9> >* derivs,
+    std::vector<Eigen::Matrix<double, 9, 9> >* hesses,
+    bool isLocalProj,
+    bool isParallel)
+{
+    int nfaces = mesh.nFaces();
+    double kstretch1 = thickness / 8.0 * lameAlpha;
+    double kstretch2 = thickness / 4.0 * lameBeta;
+    double kstretching = kstretch1 + kstretch2 - kstretch1 * kstretch1 / (kstretch1 + kstretch2);
+
+    energies.resize(nfaces);
+    if (derivs)
+        derivs->resize(nfaces);
+    if (hesses)
+        hesses->resize(nfaces);
+
+    // pass 1: classification, which also computes the current metrics
+    classifyFaces(mesh, curPos, lameAlpha, lameBeta, thickness, abars, faceRegimes, isParallel);
+
+    // pass 2: bucketing
+    std::vector<int> buckets[3];
+    for (int i = 0; i < nfaces; i++)
+        buckets[faceRegimes[i]].push_back(i);
+
+    // pass 3: one kernel per bucket
+    for (int f : buckets[slackRegime])
+    {
+        energies[f] = 0;
+        if (derivs)
+            (*derivs)[f].setZero();
+        if (hesses)
+            (*hesses)[f].setZero();
+    }
+
+    if (!derivs && !hesses)
+    {
+        // energy only: gather the metric entries of a chunk into contiguous arrays, then a straight loop over them
+        auto energyKernel = [&](const std::vector<int>& bucket, bool isWrinkled, int begin, int end)
+        {
+            int n = end - begin;
+            std::vector<double> e00(n), e01(n), e11(n), i00(n), i01(n), i11(n), dA(n), result(n);
+            for (int k = 0; k < n; k++)
+            {
+                int f = bucket[begin + k];
+                Eigen::Matrix2d e = _faceMetrics[f] - abars[f];
+                // the rest metrics may change between calls (load stepping, restarts), so their inverses are not cached
+                double det = abars[f].determinant();
+                e00[k] = e(0, 0);
+                e01[k] = e(0, 1);
+                e11[k] = e(1, 1);
+                i00[k] = abars[f](1, 1) / det;
+                i01[k] = -abars[f](0, 1) / det;
+                i11[k] = abars[f](0, 0) / det;
+                dA[k] = sqrt(det);
+            }
+            for (int k = 0; k < n; k++)
+            {
+                // strain M = abar^{-1} (a - abar)
+                double m00 = i00[k] * e00[k] + i01[k] * e01[k];
+                double m01 = i00[k] * e01[k] + i01[k] * e11[k];
+                double m10 = i01[k] * e00[k] + i11[k] * e01[k];
+                double m11 = i01[k] * e01[k] + i11[k] * e11[k];
+                double T = m00 + m11;
+                if (isWrinkled)
+                {
+                    double D = m00 * m11 - m01 * m10;
+                    double lambda = T / 2.0 + sqrt(std::max(0.0, T * T / 4.0 - D));
+                    result[k] = kstretching * 0.5 * dA[k] * lambda * lambda;
+                }
+                else
+                    result[k] = 0.5 * dA[k] * (kstretch1 * T * T + kstretch2 * (m00 * m00 + 2 * m01 * m10 + m11 * m11));
+            }
+            for (int k = 0; k < n; k++)
+                energies[bucket[begin + k]] = result[k];
+        };
+        forRange(buckets[pureTensionRegime].size(), isParallel, [&](int begin, int end) { energyKernel(buckets[pureTensionRegime], false, begin, end); });
+        forRange(buckets[wrinkledRegime].size(), isParallel, [&](int begin, int end) { energyKernel(buckets[wrinkledRegime], true, begin, end); });
+        return;
+    }
+
+    // the hessians of the metric entries are constant, and the metrics themselves come from the classification
+    std::vector<Eigen::Matrix<double, 9, 9> > ahess;
+    if (hesses && nfaces > 0)
+        firstFundamentalForm(mesh, curPos, 0, NULL, &ahess);
+
+    auto derivativeKernel = [&](const std::vector<int>& bucket, bool isWrinkled, int begin, int end)
+    {
+        Eigen::Matrix<double, 4, 9> aderiv;
+        for (int k = begin; k < end; k++)
+        {
+            int f = bucket[k];
+            firstFundamentalFormDerivative(mesh, curPos, f, aderiv);
+            Eigen::Matrix<double, 1, 9>* deriv = derivs ? &(*derivs)[f] : NULL;
+            Eigen::Matrix<double, 9, 9>* hess = hesses ? &(*hesses)[f] : NULL;
+            if (deriv)
+                deriv->setZero();
+            if (hess)
+                hess->setZero();
+            if (isWrinkled)
+                energies[f] = wrinkledKernel(_faceMetrics[f], abars[f], aderiv, ahess, kstretch1, kstretch2, deriv, hess);
+            else
+                energies[f] = pureTensionKernel(_faceMetrics[f], abars[f], aderiv, ahess, kstretch1, kstretch2, deriv, hess);
+        }
+    };
+    forRange(buckets[pureTensionRegime].size(), isParallel, [&](int begin, int end) { derivativeKernel(buckets[pureTensionRegime], false, begin, end); });
+    forRange(buckets[wrinkledRegime].size(), isParallel, [&](int begin, int end) { derivativeKernel(buckets[wrinkledRegime], true, begin, end); });
+}
+
 double StVKTensionFieldMaterial::bendingEnergy(
     const MeshConnectivity &mesh,
     const Eigen::MatrixXd &curPos,
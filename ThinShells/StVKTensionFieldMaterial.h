@@ -4,11 +4,19 @@
 /*
  * Tension field approximation of St. Venant-Kirchhoff linear material model whose energy density
  * W = alpha/2.0 tr(S)^2 + beta tr(S^2),
- * for strain tensor S = gbar^{-1}(g-gbar), where g and gbar are the current 
+ * for strain tensor S = gbar^{-1}(g-gbar), where g and gbar are the current
  * and rest metrics of the shell volume (which vary in the thickness direction
  * as defined by the surface fundamental forms).
  */
 
+// the three stretching regimes of the tension field model, determined by the principal strains of a face
+enum TensionFieldRegime
+{
+    slackRegime = 0,        // both principal strains are compressive: no energy
+    wrinkledRegime = 1,     // uniaxial tension: only the largest principal strain contributes
+    pureTensionRegime = 2   // biaxial tension: plain StVK
+};
+
 class StVKTensionFieldMaterial : public ElasticShellMaterial
 {
 public:
@@ -22,6 +30,23 @@ public:
         Eigen::Matrix<double, 9, 9>* hessian,
         bool isLocalProj = false) override;
 
+    /*
+     * Batched version: all the faces are classified first and bucketed by regime, then each bucket runs its own
+     * branch-free kernel. The slack bucket costs nothing, and both the energy-only evaluation (line search, over
+     * contiguous arrays) and the derivative kernels reuse the metrics computed during the classification. The
+     * regimes stay in faceRegimes, so keep one material per model to read them back.
+     */
+    virtual void stretchingEnergies(
+        const MeshConnectivity& mesh,
+        const Eigen::MatrixXd& curPos,
+        double lameAlpha, double lameBeta, double thickness,
+        const std::vector<Eigen::Matrix2d>& abars,
+        std::vector<double>& energies,
+        std::vector<Eigen::Matrix<double, 1, 9> >* derivs,
+        std::vector<Eigen::Matrix<double, 9, 9> >* hesses,
+        bool isLocalProj = false,
+        bool isParallel = false) override;
+
     virtual double bendingEnergy(
         const MeshConnectivity& mesh,
         const Eigen::MatrixXd& curPos,
@@ -33,4 +58,19 @@ public:
         Eigen::MatrixXd* derivative, // F(face, i), then the three vertices opposite F(face,i), then the thetas on oppositeEdge(face,i)
         Eigen::MatrixXd* hessian,
         bool isLocalProj = false) override;
-};
\ No newline at end of file
+
+    // classify every face into one of the TensionFieldRegime, and cache the current first fundamental forms
+    void classifyFaces(
+        const MeshConnectivity& mesh,
+        const Eigen::MatrixXd& curPos,
+        double lameAlpha, double lameBeta, double thickness,
+        const std::vector<Eigen::Matrix2d>& abars,
+        std::vector<int>& regimes,
+        bool isParallel = false);
+
+public:
+    std::vector<int> faceRegimes;   // per-face regimes of the last batched evaluation
+
+private:
+    std::vector<Eigen::Matrix2d> _faceMetrics;  // current first fundamental forms computed during classification
+};
@@ -23,6 +23,8 @@ std::string outputFolder = "";
 SFFType sfftype = MidedgeAverage;
 double perturbMag = 0;
 bool quietOpt = false;
+std::string linearSolverType = "";
+std::string solverType = "";
 
 
 void jitter(double magnitude)
@@ -89,6 +91,8 @@ int main(int argc, char* argv[])
     CLI::App app("Quasi-static Simulator");
     app.add_option("input,-i,--input", inputPath, "Input model (json file)")->required()->check(CLI::ExistingFile);
 	app.add_option("-o,--output", outputFolder, "Output folder");
+	app.add_option("-s,--linearSolver", linearSolverType, "Linear solver: auto, cholmod_supernodal, cholmod_simplicial, eigen_llt, eigen_ldlt, mixed_ldlt, pcg, gmg or schur, default is the one in the json file");
+	app.add_option("--solver", solverType, "Nonlinear solver: newton (quasi-static load stepping), lbfgs or trust_region (full simulation), default is the one in the json file");
 	// app.add_option("-n,--numIter", fullSimOptParams.iterations, "Number of iterations, default is 1000");
 	// app.add_option("-g,--gradTol", fullSimOptParams.gradNorm, "The tolerance for gradient norm termination, default is 1e-6");
 	// app.add_option("-x,--xTol", fullSimOptParams.xDelta, "The tolerance of variable update termination, default is 0");
@@ -106,16 +110,39 @@ int main(int argc, char* argv[])
     }
 
 	loadProblem(inputPath);
+	if (linearSolverType != "")
+		setup.linearSolverType = linearSolverType;
+	if (solverType != "")
+		setup.solverType = solverType;
 	if(outputFolder == "")
 	{
 		outputFolder = workingFolder;
 	}
 
 	jitter(perturbMag);
-	for (int k = 1; k <= numSteps; k++) 
+	if (setup.isArcLengthContinuation)
 	{
+		ThinShellSolver::arcLengthContinuationSolver(setup, curState, workingFolder + std::regex_replace(setup.restMeshPath, std::regex(".obj"), ""), fullSimOptParams);
+	}
+	else if (setup.eigenAnalysis != "none")
+	{
+		ThinShellSolver::eigenAnalysisSolver(setup, curState, workingFolder + std::regex_replace(setup.restMeshPath, std::regex(".obj"), ""), fullSimOptParams);
+	}
+	else if (setup.isLinearStatic)
+	{
+		ThinShellSolver::linearStaticSolver(setup, curState, workingFolder + std::regex_replace(setup.restMeshPath, std::regex(".obj"), ""), fullSimOptParams);
+	}
+	else if (setup.solverType == "lbfgs" || setup.solverType == "trust_region")
+	{
+		fullSimOptParams.solverType = setup.solverType == "lbfgs" ? Lbfgs : TrustRegion;
+		ThinShellSolver::fullSimNewtonStaticSolver(setup, curState, workingFolder + std::regex_replace(setup.restMeshPath, std::regex(".obj"), ""), fullSimOptParams);
+	}
+	else
+	{
+		if (setup.solverType != "newton")
+			std::cout << "unknown solver type " << setup.solverType << ", use newton." << std::endl;
 		// ThinShellSolver::fullSimNewtonStaticSolver(setup, curState, workingFolder + std::regex_replace(setup.restMeshPath, std::regex(".obj"), ""), fullSimOptParams);
-		ThinShellSolver::quasiStaticNewtonSolver(setup, curState, workingFolder + std::regex_replace(setup.restMeshPath, std::regex(".obj"), ""), fullSimOptParams);
+		ThinShellSolver::loadSteppingSolver(setup, curState, workingFolder + std::regex_replace(setup.restMeshPath, std::regex(".obj"), ""), fullSimOptParams);
 		// ThinShellSolver::linearPlateBending(setup, curState, workingFolder + std::regex_replace(setup.restMeshPath, std::regex(".obj"), ""), fullSimOptParams);
 	}
 
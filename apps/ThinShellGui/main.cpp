@@ -350,12 +350,14 @@ void callback() {
         if (ImGui::Button("Optimize ThinShell", ImVec2(-1, 0)))
         {
             jitter(noiseNorm);
-            for (int k = 1; k <= numSteps; k++)
+            if (setup.solverType == "lbfgs" || setup.solverType == "trust_region")
             {
-                // ThinShellSolver::fullSimNewtonStaticSolver(setup, curState, filePathPrefix, fullSimOptParams);
-                ThinShellSolver::quasiStaticNewtonSolver(setup, curState, filePathPrefix, fullSimOptParams);
-                // ThinShellSolver::linearPlateBending(setup, curState, filePathPrefix, fullSimOptParams);
+                fullSimOptParams.solverType = setup.solverType == "lbfgs" ? Lbfgs : TrustRegion;
+                ThinShellSolver::fullSimNewtonStaticSolver(setup, curState, filePathPrefix, fullSimOptParams);
             }
+            else
+                ThinShellSolver::loadSteppingSolver(setup, curState, filePathPrefix, fullSimOptParams);
+            // ThinShellSolver::linearPlateBending(setup, curState, filePathPrefix, fullSimOptParams);
             updateView();
         }
 